@@ -2,12 +2,18 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <addresstype.h>
 #include <bench/bench.h>
 #include <coins.h>
+#include <key.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
+#include <tinyformat.h>
+#include <uint256.h>
 
+#include <utility>
 #include <vector>
 
 // Microbenchmark for simple accesses to a CCoinsViewCache database. Note from
@@ -50,4 +56,42 @@ static void CCoinsCaching(benchmark::Bench& bench)
     ECC_Stop();
 }
 
+// Memory of a coins cache per cached coin, for outputs like those of a
+// proof-of-stake UTXO set: half pay to public key outputs of coinstakes and
+// half pay to public key hash outputs. Reports the bytes per coin after the
+// time to add the coins.
+static void CCoinsCachingMemory(benchmark::Bench& bench)
+{
+    constexpr size_t NUM_COINS{100'000};
+    FastRandomContext rng(/*fDeterministic=*/true);
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    coins.reserve(NUM_COINS);
+    for (size_t i{0}; i < NUM_COINS; ++i) {
+        const bool coinstake{i % 2 == 0};
+        CScript script;
+        if (coinstake) {
+            std::vector<unsigned char> pubkey{rng.randbytes(CPubKey::COMPRESSED_SIZE)};
+            pubkey[0] = 0x02;
+            script << pubkey << OP_CHECKSIG;
+        } else {
+            script = GetScriptForDestination(PKHash{uint160{rng.randbytes(uint160::size())}});
+        }
+        coins.emplace_back(COutPoint{rng.rand256(), 1}, Coin{CTxOut{int64_t(rng.randrange(100 * COIN)), script}, int(rng.randrange(5'000'000)), /*fCoinBaseIn=*/false, coinstake, /*nTimeIn=*/0});
+    }
+
+    size_t memory_usage{0};
+    bench.batch(NUM_COINS).unit("coin").run([&] {
+        CCoinsView coins_dummy;
+        CCoinsViewCache cache(&coins_dummy);
+        for (const auto& [outpoint, coin] : coins) {
+            cache.AddCoin(outpoint, Coin{coin}, /*possible_overwrite=*/false);
+        }
+        memory_usage = cache.DynamicMemoryUsage();
+    });
+    if (bench.output()) {
+        *bench.output() << strprintf("%s: %.1f bytes per cached coin\n", bench.name(), double(memory_usage) / NUM_COINS);
+    }
+}
+
 BENCHMARK(CCoinsCaching, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CCoinsCachingMemory, benchmark::PriorityLevel::HIGH);
@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <pow.h>
+#include <streams.h>
+#include <test/util/script.h>
+#include <test/util/setup_common.h>
+#include <util/chaintype.h>
+#include <validation.h>
+
+/**
+ * Headers and blocks of the legacy range (nVersion <= 6) are identified by
+ * their scrypt hash. These benchmarks replay a chain of such blocks the way
+ * header sync (a headers message from a peer) and -reindex/-loadblock
+ * (LoadExternalBlockFile) see them, deserializing fresh copies every time.
+ * The first run accepts the chain, later runs measure the work done for
+ * headers and blocks that are seen again.
+ */
+static constexpr size_t LEGACY_CHAIN_SIZE{2000};
+
+static std::vector<CBlock> CreateLegacyChain(const CChainParams& params)
+{
+    std::vector<CBlock> chain(LEGACY_CHAIN_SIZE);
+    uint256 prev_hash{params.GenesisBlock().GetHash()};
+    uint32_t time{params.GenesisBlock().nTime};
+    for (size_t height{0}; height < chain.size(); ++height) {
+        CBlock& block{chain[height]};
+
+        CMutableTransaction coinbase_tx;
+        coinbase_tx.vin.resize(1);
+        coinbase_tx.vin[0].prevout.SetNull();
+        coinbase_tx.vin[0].scriptSig = CScript() << (height + 1) << OP_0;
+        coinbase_tx.vout.resize(1);
+        coinbase_tx.vout[0].scriptPubKey = P2WSH_OP_TRUE;
+        coinbase_tx.vout[0].nValue = 0;
+        block.vtx = {MakeTransactionRef(std::move(coinbase_tx))};
+
+        block.nVersion = 6;
+        block.hashPrevBlock = prev_hash;
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        block.nTime = ++time;
+        block.nBits = UintToArith256(params.GetConsensus().powLimit).GetCompact();
+        block.nNonce = 0;
+        while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params.GetConsensus())) {
+            ++block.nNonce;
+        }
+        prev_hash = block.GetHash();
+    }
+    return chain;
+}
+
+static void LegacyHeaderSync(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const TestingSetup>(ChainType::REGTEST)};
+    ChainstateManager& chainman{*testing_setup->m_node.chainman};
+
+    // Serialized like a headers message
+    CDataStream headers_msg{SER_NETWORK};
+    std::vector<CBlockHeader> headers;
+    for (const CBlock& block : CreateLegacyChain(chainman.GetParams())) {
+        headers.push_back(block.GetBlockHeader());
+    }
+    headers_msg << headers;
+
+    bench.run([&] {
+        std::vector<CBlockHeader> received;
+        CDataStream{headers_msg} >> received;
+        assert(HasValidProofOfWork(received, chainman.GetConsensus()));
+        BlockValidationState state;
+        const CBlockIndex* pindex{nullptr};
+        assert(chainman.ProcessNewBlockHeaders(received, /*min_pow_checked=*/true, state, /*old_client=*/false, &pindex));
+        assert(pindex && pindex->GetBlockHash() == received.back().GetHash());
+    });
+}
+
+static void LegacyReindex(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const TestingSetup>(ChainType::REGTEST)};
+    ChainstateManager& chainman{*testing_setup->m_node.chainman};
+
+    // Write the chain like a datadir/blocks/blk?????.dat file
+    const fs::path blkfile{testing_setup->m_path_root / "blk.dat"};
+    {
+        CAutoFile file{fsbridge::fopen(blkfile, "wb+")};
+        for (const CBlock& block : CreateLegacyChain(chainman.GetParams())) {
+            file << chainman.GetParams().MessageStart() << static_cast<uint32_t>(GetSerializeSize(TX_WITH_WITNESS(block))) << TX_WITH_WITNESS(block);
+        }
+    }
+
+    std::multimap<uint256, FlatFilePos> blocks_with_unknown_parent;
+    FlatFilePos pos;
+    bench.run([&] {
+        CAutoFile file{fsbridge::fopen(blkfile, "rb")};
+        chainman.LoadExternalBlockFile(file, &pos, &blocks_with_unknown_parent);
+    });
+    fs::remove(blkfile);
+}
+
+BENCHMARK(LegacyHeaderSync, benchmark::PriorityLevel::HIGH);
+BENCHMARK(LegacyReindex, benchmark::PriorityLevel::HIGH);
@@ -0,0 +1,77 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <util/chaintype.h>
+
+#include <vector>
+
+/**
+ * Retargeting looks up the last blocks of the wanted proof type, which used
+ * to walk pprev across every block of the other type. These benchmarks run
+ * the target checks of header sync on an index with mixed runs of
+ * proof-of-work and proof-of-stake blocks, and the proof-of-work target of a
+ * tip after a long proof-of-stake run like on mainnet.
+ */
+static constexpr size_t HEADER_CHAIN_SIZE{20000};
+
+static void BuildHeaderChain(std::vector<CBlockIndex>& chain, size_t pow_blocks, size_t max_run)
+{
+    FastRandomContext rng(true);
+    const Consensus::Params& params{Params().GetConsensus()};
+    uint32_t time{(uint32_t)params.nProtocolV3_1Time};
+    bool fProofOfStake{false};
+    size_t run{0};
+    for (size_t height{0}; height < chain.size(); ++height) {
+        CBlockIndex& index{chain[height]};
+        if (height >= pow_blocks && run-- == 0) {
+            fProofOfStake = max_run ? !fProofOfStake : true;
+            run = max_run ? rng.randrange(max_run) : chain.size();
+        }
+        index.nHeight = height;
+        index.pprev = height ? &chain[height - 1] : nullptr;
+        index.nTime = (time += 16);
+        index.nBits = UintToArith256(fProofOfStake ? params.posLimitV2 : params.powLimit).GetCompact();
+        if (fProofOfStake) index.SetProofOfStake();
+        index.BuildPrevOtherType();
+    }
+}
+
+static void PoSHeaderSyncRetarget(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(ChainType::MAIN)};
+    std::vector<CBlockIndex> chain(HEADER_CHAIN_SIZE);
+    BuildHeaderChain(chain, /*pow_blocks=*/1, /*max_run=*/500);
+
+    bench.run([&] {
+        // What AcceptBlockHeader does per header: link the new entry and check nBits
+        for (size_t height{1}; height < chain.size(); ++height) {
+            CBlockIndex& index{chain[height]};
+            index.BuildPrevOtherType();
+            const unsigned int nBits{GetNextTargetRequired(index.pprev, Params().GetConsensus(), index.IsProofOfStake())};
+            ankerl::nanobench::doNotOptimizeAway(nBits);
+        }
+    });
+}
+
+static void PoWRetargetAfterPoS(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(ChainType::MAIN)};
+    std::vector<CBlockIndex> chain(HEADER_CHAIN_SIZE);
+    BuildHeaderChain(chain, /*pow_blocks=*/100, /*max_run=*/0);
+
+    bench.run([&] {
+        const unsigned int nBits{GetNextTargetRequired(&chain.back(), Params().GetConsensus(), /*fProofOfStake=*/false)};
+        ankerl::nanobench::doNotOptimizeAway(nBits);
+    });
+}
+
+BENCHMARK(PoSHeaderSyncRetarget, benchmark::PriorityLevel::HIGH);
+BENCHMARK(PoWRetargetAfterPoS, benchmark::PriorityLevel::HIGH);
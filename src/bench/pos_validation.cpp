@@ -0,0 +1,176 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <node/stake_weight.h>
+#include <pos.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <script/signingprovider.h>
+#include <script/sign.h>
+#include <test/util/setup_common.h>
+#include <util/chaintype.h>
+#include <validation.h>
+
+#include <cassert>
+#include <vector>
+
+/**
+ * Proof-of-stake checks of block validation on a synthetic chain: the kernel
+ * and coinstake signature of CheckProofOfStake, the block signature of
+ * CheckBlock, and the network stake weight estimate of getstakinginfo.
+ * Retargeting is covered by pos_header_sync.cpp.
+ */
+static constexpr size_t POS_CHAIN_SIZE{20000};
+//! Height of the coin staked by the coinstake, in the middle of the chain
+static constexpr int STAKE_COIN_HEIGHT{10000};
+
+//! Chain with one in four blocks proof-of-work and random proof-of-stake difficulties
+static void BuildPoSChain(std::vector<CBlockIndex>& chain)
+{
+    FastRandomContext rng(true);
+    const Consensus::Params& params{Params().GetConsensus()};
+    uint32_t time{(uint32_t)params.nProtocolV3_1Time};
+    for (size_t height{0}; height < chain.size(); ++height) {
+        CBlockIndex& index{chain[height]};
+        index.nHeight = height;
+        index.pprev = height ? &chain[height - 1] : nullptr;
+        index.nTime = (time += 16 * (1 + rng.randrange(8)));
+        index.nBits = 0x1c000000 | (0x1000 + rng.randrange(0xf000));
+        index.nStakeModifier = rng.rand256();
+        if (height && rng.randrange(4)) index.SetProofOfStake();
+        index.BuildPrevOtherType();
+        index.BuildSkip();
+    }
+}
+
+/** A pay to public key coin of the chain and a signed coinstake spending it, with a
+ *  timestamp meeting the target so that every check runs to the end */
+struct StakedCoin
+{
+    CKey key;
+    COutPoint prevout;
+    Coin coin;
+    CTransactionRef coinstake;
+    unsigned int nBits{0x1c00ffff};
+};
+
+static StakedCoin CreateStakedCoin(const std::vector<CBlockIndex>& chain)
+{
+    FastRandomContext rng(true);
+    StakedCoin staked;
+    staked.key.MakeNewKey(true);
+    const CScript script{GetScriptForRawPubKey(staked.key.GetPubKey())};
+    staked.prevout = COutPoint(rng.rand256(), 0);
+    staked.coin = Coin(CTxOut(100 * COIN, script), STAKE_COIN_HEIGHT, /*fCoinBaseIn=*/false, /*fCoinStakeIn=*/false, /*nTimeIn=*/0);
+
+    const CBlockIndex& tip{chain.back()};
+    const uint32_t blockFromTime{chain[STAKE_COIN_HEIGHT].nTime};
+    CMutableTransaction tx;
+    tx.nTime = (tip.nTime + 16) & ~0xf;
+    while (!CheckStakeKernelHash(&tip, staked.nBits, blockFromTime, staked.coin.out.nValue, staked.prevout, tx.nTime)) {
+        tx.nTime += 16;
+    }
+    tx.vin.emplace_back(staked.prevout);
+    tx.vout.emplace_back(0, CScript());
+    tx.vout.emplace_back(staked.coin.out.nValue + COIN, script);
+
+    FillableSigningProvider keystore;
+    keystore.AddKey(staked.key);
+    SignatureData sig_data;
+    const bool signed_tx{SignSignature(keystore, script, tx, 0, staked.coin.out.nValue, SIGHASH_ALL, sig_data)};
+    assert(signed_tx);
+    staked.coinstake = MakeTransactionRef(std::move(tx));
+    return staked;
+}
+
+static void CheckStakedCoin(benchmark::Bench& bench, bool fCheckSignature)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(ChainType::MAIN)};
+    std::vector<CBlockIndex> chain(POS_CHAIN_SIZE);
+    BuildPoSChain(chain);
+    const StakedCoin staked{CreateStakedCoin(chain)};
+
+    CCoinsView view_dummy;
+    CCoinsViewCache view(&view_dummy);
+    view.AddCoin(staked.prevout, Coin{staked.coin}, /*possible_overwrite=*/false);
+
+    bench.run([&] {
+        BlockValidationState state;
+        const bool valid{CheckProofOfStake(&chain.back(), *staked.coinstake, staked.nBits, state, view, staked.coinstake->nTime, fCheckSignature)};
+        assert(valid);
+    });
+}
+
+// As ProcessBlockFound checks a staked block before processing it
+static void CheckProofOfStakeSigned(benchmark::Bench& bench) { CheckStakedCoin(bench, /*fCheckSignature=*/true); }
+// As ConnectBlock checks it, the coinstake signature being left to the script checks
+static void CheckProofOfStakeKernel(benchmark::Bench& bench) { CheckStakedCoin(bench, /*fCheckSignature=*/false); }
+
+static void CheckStakedBlockSignature(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(ChainType::MAIN)};
+    std::vector<CBlockIndex> chain(POS_CHAIN_SIZE);
+    BuildPoSChain(chain);
+    const StakedCoin staked{CreateStakedCoin(chain)};
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.emplace_back(0, CScript());
+    CBlock block;
+    block.vtx = {MakeTransactionRef(std::move(coinbase)), staked.coinstake};
+    block.hashPrevBlock = uint256::ONE;
+    block.nTime = staked.coinstake->nTime;
+    block.nBits = staked.nBits;
+    const bool signed_block{staked.key.Sign(block.GetHash(), block.vchBlockSig)};
+    assert(signed_block);
+
+    bench.run([&] {
+        const bool valid{CheckBlockSignature(block)};
+        assert(valid);
+    });
+}
+
+// Network stake weight over the default windows, rebuilt at startup and then
+// updated per block
+static void StakeWeightEstimatorInit(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(ChainType::MAIN)};
+    std::vector<CBlockIndex> chain(POS_CHAIN_SIZE);
+    BuildPoSChain(chain);
+
+    bench.run([&] {
+        node::StakeWeightEstimator estimator(Params().GetConsensus().nStakeTimestampMask);
+        estimator.Init(&chain.back());
+        ankerl::nanobench::doNotOptimizeAway(estimator.GetKernelsPS());
+    });
+}
+
+static void StakeWeightEstimatorBlockConnected(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(ChainType::MAIN)};
+    std::vector<CBlockIndex> chain(POS_CHAIN_SIZE);
+    BuildPoSChain(chain);
+    node::StakeWeightEstimator estimator(Params().GetConsensus().nStakeTimestampMask);
+    estimator.Init(&chain[chain.size() - 2]);
+
+    bench.run([&] {
+        estimator.BlockConnected(ChainstateRole::NORMAL, nullptr, &chain.back());
+        ankerl::nanobench::doNotOptimizeAway(estimator.GetKernelsPS());
+        estimator.BlockDisconnected(nullptr, &chain.back());
+    });
+}
+
+BENCHMARK(CheckProofOfStakeSigned, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CheckProofOfStakeKernel, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CheckStakedBlockSignature, benchmark::PriorityLevel::HIGH);
+BENCHMARK(StakeWeightEstimatorInit, benchmark::PriorityLevel::HIGH);
+BENCHMARK(StakeWeightEstimatorBlockConnected, benchmark::PriorityLevel::HIGH);
@@ -0,0 +1,74 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <pos.h>
+#include <primitives/transaction.h>
+#include <random.h>
+
+#include <vector>
+
+static constexpr size_t NUM_STAKE_CANDIDATES{100000};
+static constexpr unsigned int STAKE_BITS{0x1a0fffff};
+static constexpr uint32_t STAKE_TIME{1700000000};
+
+struct StakeCandidate {
+    COutPoint prevout;
+    uint32_t blockFromTime;
+    CAmount amount;
+};
+
+static std::vector<StakeCandidate> CreateStakeCandidates()
+{
+    FastRandomContext rng(true);
+    std::vector<StakeCandidate> candidates;
+    candidates.reserve(NUM_STAKE_CANDIDATES);
+    for (size_t i = 0; i < NUM_STAKE_CANDIDATES; i++) {
+        candidates.push_back({COutPoint(rng.rand256(), rng.randrange(4)), STAKE_TIME - 86400 - (uint32_t)rng.randrange(86400 * 365), (CAmount)(1 + rng.randrange(1000 * COIN))});
+    }
+    return candidates;
+}
+
+// Kernel search of a 100k UTXO wallet with the consensus kernel check
+static void StakeKernelSearchScalar(benchmark::Bench& bench)
+{
+    const std::vector<StakeCandidate> candidates{CreateStakeCandidates()};
+    CBlockIndex index;
+    index.nStakeModifier = FastRandomContext(true).rand256();
+    uint32_t nTime = STAKE_TIME;
+
+    bench.batch(candidates.size()).unit("kernel").run([&] {
+        nTime += 16;
+        size_t hits = 0;
+        for (const StakeCandidate& candidate : candidates) {
+            hits += CheckStakeKernelHash(&index, STAKE_BITS, candidate.blockFromTime, candidate.amount, candidate.prevout, nTime);
+        }
+        ankerl::nanobench::doNotOptimizeAway(hits);
+    });
+}
+
+// Kernel search of a 100k UTXO wallet with candidates prepared once per tip
+static void StakeKernelSearchBatch(benchmark::Bench& bench)
+{
+    const std::vector<StakeCandidate> candidates{CreateStakeCandidates()};
+    const uint256 nStakeModifier{FastRandomContext(true).rand256()};
+    std::vector<CStakeKernel> kernels(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        PrepareStakeKernel(nStakeModifier, STAKE_BITS, candidates[i].blockFromTime, candidates[i].amount, candidates[i].prevout, kernels[i]);
+    }
+    uint32_t nTime = STAKE_TIME;
+    std::vector<size_t> hits;
+
+    bench.batch(kernels.size()).unit("kernel").run([&] {
+        nTime += 16;
+        hits.clear();
+        CheckStakeKernelHashBatch(kernels, nTime, hits);
+        ankerl::nanobench::doNotOptimizeAway(hits);
+    });
+}
+
+BENCHMARK(StakeKernelSearchScalar, benchmark::PriorityLevel::HIGH);
+BENCHMARK(StakeKernelSearchBatch, benchmark::PriorityLevel::HIGH);
@@ -0,0 +1,199 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/merkle.h>
+#include <kernel/chain.h>
+#include <node/context.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+#include <wallet/staking.h>
+#include <wallet/test/util.h>
+#include <wallet/wallet.h>
+
+#include <atomic>
+#include <cassert>
+#include <thread>
+
+namespace wallet {
+//! Append a block to the active chain without validating it, add its outputs to the
+//! UTXO set and notify the wallet
+static void AddStakingBlock(const node::NodeContext& context, CWallet& wallet, const CScript& script, int num_outputs)
+{
+    const CBlockIndex* tip{WITH_LOCK(::cs_main, return context.chainman->ActiveTip())};
+
+    CMutableTransaction coinbase_tx;
+    coinbase_tx.vin.resize(1);
+    coinbase_tx.vin[0].prevout.SetNull();
+    coinbase_tx.vin[0].scriptSig = CScript() << (tip->nHeight + 1) << OP_0;
+    coinbase_tx.vout.resize(std::max(num_outputs, 1));
+    for (CTxOut& out : coinbase_tx.vout) {
+        out.scriptPubKey = num_outputs ? script : CScript() << OP_TRUE;
+        out.nValue = 10 * COIN;
+    }
+
+    CBlock block;
+    block.vtx = {MakeTransactionRef(std::move(coinbase_tx))};
+    block.nVersion = VERSIONBITS_LAST_OLD_BLOCK_VERSION;
+    block.hashPrevBlock = tip->GetBlockHash();
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.nTime = tip->nTime + 64;
+    block.nBits = tip->nBits;
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(::cs_main);
+        CBlockIndex* pindexNew{context.chainman->m_blockman.AddToBlockIndex(block, context.chainman->m_best_header, false)};
+        context.chainman->ActiveChain().SetTip(*pindexNew);
+        AddCoins(context.chainman->ActiveChainstate().CoinsTip(), *block.vtx[0], pindexNew->nHeight);
+        pindex = pindexNew;
+    }
+    wallet.blockConnected(ChainstateRole::NORMAL, kernel::MakeBlockInfo(pindex, &block));
+}
+
+//! Fill the wallet with num_coins mature outputs it can stake with
+static void AddStakeableCoins(const node::NodeContext& context, CWallet& wallet, int num_coins)
+{
+    const CScript script{GetScriptForDestination(getNewDestination(wallet, OutputType::LEGACY))};
+    for (int added = 0; added < num_coins; added += 1000) {
+        AddStakingBlock(context, wallet, script, std::min(1000, num_coins - added));
+    }
+    for (int i = 0; i <= Params().GetConsensus().nCoinbaseMaturity; i++) {
+        AddStakingBlock(context, wallet, script, 0);
+    }
+}
+
+static std::unique_ptr<CWallet> CreateStakingWallet(const node::NodeContext& context)
+{
+    auto wallet = std::make_unique<CWallet>(context.chain.get(), "", CreateMockableWalletDatabase());
+    LOCK(wallet->cs_wallet);
+    wallet->SetWalletFlag(WALLET_FLAG_DESCRIPTORS);
+    wallet->SetupDescriptorScriptPubKeyMans();
+    return wallet;
+}
+
+// Time to acquire cs_main while another thread keeps searching for kernels
+// over a 10k UTXO wallet, either holding cs_main and cs_wallet for the whole
+// staking round as PoSMiner used to, or only while taking the snapshot.
+static void StakeSearchLockContention(benchmark::Bench& bench, bool hold_locks)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    SetMockTime(test_setup->m_node.chainman->GetParams().GenesisBlock().nTime);
+    const auto wallet{CreateStakingWallet(test_setup->m_node)};
+    AddStakeableCoins(test_setup->m_node, *wallet, 10000);
+
+    std::atomic<bool> stop{false};
+    std::thread staker([&] {
+        StakeSnapshot snapshot;
+        StakeKernelHits hits;
+        uint32_t nTime = WITH_LOCK(::cs_main, return test_setup->m_node.chainman->ActiveTip()->nTime);
+        while (!stop) {
+            nTime += 16;
+            if (hold_locks) {
+                LOCK2(wallet->cs_wallet, ::cs_main);
+                CreateStakeSnapshot(*wallet, snapshot);
+                FindStakeKernels(snapshot, nTime, hits);
+            } else {
+                CreateStakeSnapshot(*wallet, snapshot);
+                FindStakeKernels(snapshot, nTime, hits);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+    });
+
+    bench.run([&] {
+        LOCK(::cs_main);
+        ankerl::nanobench::doNotOptimizeAway(test_setup->m_node.chainman->ActiveTip());
+    });
+
+    stop = true;
+    staker.join();
+}
+
+static void StakeSearchLockContentionLocked(benchmark::Bench& bench) { StakeSearchLockContention(bench, /*hold_locks=*/true); }
+static void StakeSearchLockContentionSnapshot(benchmark::Bench& bench) { StakeSearchLockContention(bench, /*hold_locks=*/false); }
+
+// Listing the coins a wallet can stake with, done for the stake weight and by
+// the coin selection of every snapshot and coinstake
+static void ListStakeCoins(benchmark::Bench& bench, int num_coins)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    SetMockTime(test_setup->m_node.chainman->GetParams().GenesisBlock().nTime);
+    const auto wallet{CreateStakingWallet(test_setup->m_node)};
+    AddStakeableCoins(test_setup->m_node, *wallet, num_coins);
+
+    std::vector<std::pair<const CWalletTx*, unsigned int>> coins;
+    bench.run([&] {
+        LOCK(wallet->cs_wallet);
+        coins.clear();
+        AvailableCoinsForStaking(*wallet, coins);
+        assert(coins.size() == (size_t)num_coins);
+    });
+}
+
+// Taking the stake candidates of a wallet and preparing their kernels, once per tip
+static void TakeStakeSnapshot(benchmark::Bench& bench, int num_coins)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    SetMockTime(test_setup->m_node.chainman->GetParams().GenesisBlock().nTime);
+    const auto wallet{CreateStakingWallet(test_setup->m_node)};
+    AddStakeableCoins(test_setup->m_node, *wallet, num_coins);
+
+    StakeSnapshot snapshot;
+    bench.run([&] {
+        const bool found{CreateStakeSnapshot(*wallet, snapshot)};
+        assert(found && snapshot.kernels.size() == (size_t)num_coins);
+    });
+}
+
+// Turning a kernel found in a snapshot into a signed coinstake
+static void StakeKernel(benchmark::Bench& bench, int num_coins)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    SetMockTime(test_setup->m_node.chainman->GetParams().GenesisBlock().nTime);
+    const auto wallet{CreateStakingWallet(test_setup->m_node)};
+    AddStakeableCoins(test_setup->m_node, *wallet, num_coins);
+
+    StakeSnapshot snapshot;
+    bool found{CreateStakeSnapshot(*wallet, snapshot)};
+    assert(found);
+    StakeKernelHits hits;
+    uint32_t nTime = WITH_LOCK(::cs_main, return test_setup->m_node.chainman->ActiveTip()->nTime) & ~0xf;
+    do {
+        nTime += 16;
+    } while (!FindStakeKernels(snapshot, nTime, hits));
+
+    bench.run([&] {
+        CMutableTransaction tx;
+        tx.nTime = nTime;
+        CAmount nFees{0};
+        found = CreateCoinStake(*wallet, snapshot.nBits, hits.prevouts, tx, nFees, CNoDestination(), &snapshot.signing);
+        assert(found);
+    });
+}
+
+static void AvailableCoinsForStaking1k(benchmark::Bench& bench) { ListStakeCoins(bench, 1000); }
+static void AvailableCoinsForStaking10k(benchmark::Bench& bench) { ListStakeCoins(bench, 10000); }
+static void AvailableCoinsForStaking100k(benchmark::Bench& bench) { ListStakeCoins(bench, 100000); }
+static void CreateStakeSnapshot1k(benchmark::Bench& bench) { TakeStakeSnapshot(bench, 1000); }
+static void CreateStakeSnapshot10k(benchmark::Bench& bench) { TakeStakeSnapshot(bench, 10000); }
+static void CreateStakeSnapshot100k(benchmark::Bench& bench) { TakeStakeSnapshot(bench, 100000); }
+static void CreateCoinStake1k(benchmark::Bench& bench) { StakeKernel(bench, 1000); }
+static void CreateCoinStake10k(benchmark::Bench& bench) { StakeKernel(bench, 10000); }
+static void CreateCoinStake100k(benchmark::Bench& bench) { StakeKernel(bench, 100000); }
+
+BENCHMARK(StakeSearchLockContentionLocked, benchmark::PriorityLevel::LOW);
+BENCHMARK(StakeSearchLockContentionSnapshot, benchmark::PriorityLevel::LOW);
+BENCHMARK(AvailableCoinsForStaking1k, benchmark::PriorityLevel::HIGH);
+BENCHMARK(AvailableCoinsForStaking10k, benchmark::PriorityLevel::HIGH);
+BENCHMARK(AvailableCoinsForStaking100k, benchmark::PriorityLevel::LOW);
+BENCHMARK(CreateStakeSnapshot1k, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CreateStakeSnapshot10k, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CreateStakeSnapshot100k, benchmark::PriorityLevel::LOW);
+BENCHMARK(CreateCoinStake1k, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CreateCoinStake10k, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CreateCoinStake100k, benchmark::PriorityLevel::LOW);
+} // namespace wallet
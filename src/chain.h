@@ -154,6 +154,11 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip{nullptr};
 
+    //! (memory only) pointer to the index of the closest predecessor of the other proof
+    //! type (proof-of-work for a proof-of-stake block and the reverse), or to the genesis
+    //! block if there is none
+    CBlockIndex* pprevOtherType{nullptr};
+
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight{0};
 
@@ -384,6 +389,10 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Build the pointer to the closest predecessor of the other proof type.
+    //! Needs pprev and the proof-of-stake flag to be set.
+    void BuildPrevOtherType();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
@@ -546,6 +555,14 @@ public:
 /** Get the last block index entry. */
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 
+/**
+ * Get the difficulty of the net wrt to the given block index.
+ *
+ * @return A floating point number that is a multiple of the main net minimum
+ * difficulty (4295032833 hashes).
+ */
+double GetDifficulty(const CBlockIndex* blockindex);
+
 /** Get a locator for a block index entry. */
 CBlockLocator GetLocator(const CBlockIndex* index);
 
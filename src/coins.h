@@ -37,13 +37,14 @@ public:
     CTxOut out;
 
     //! whether containing transaction was a coinbase
-    unsigned int fCoinBase : 1;
+    uint32_t fCoinBase : 1;
 
     //! whether containing transaction was a coinstake
-    unsigned int fCoinStake : 1;
+    uint32_t fCoinStake : 1;
 
-    //! at which height this containing transaction was included in the active block chain
-    uint32_t nHeight : 31;
+    //! at which height this containing transaction was included in the active block chain,
+    //! 30 bits as in the serialization so that both flags and the height share one word
+    uint32_t nHeight : 30;
 
     //! time of the transaction
     unsigned int nTime;
@@ -103,6 +104,9 @@ public:
     }
 };
 
+//! The flags and the height share one word next to nTime, keep new fields from padding every cached coin
+static_assert(sizeof(Coin) == sizeof(CTxOut) + 8, "Coin is larger than its packed layout");
+
 /**
  * A Coin in one level of the coins database caching hierarchy.
  *
@@ -311,6 +315,16 @@ public:
      */
     void EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coin);
 
+    /**
+     * Add an unspent coin read from the backing view by the caller, as a lookup
+     * through this cache would have done. Has no effect if the outpoint is
+     * already cached, as the cached entry may be more recent than the backing view.
+     *
+     * Used to read the inputs of a block in parallel before connecting it.
+     * @sa Chainstate::PrefetchInputs()
+     */
+    void AddFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -82,6 +82,7 @@ enum class BlockValidationResult {
     BLOCK_HEADER_SPAM,       //!< reject block header from the spam filter
     BLOCK_HEADER_REJECT,     //!< reject only the block header, but not ban the node
     BLOCK_HEADER_SYNC,       //!< reject the block header due to synchronization problems, used to punish the node less
+    BLOCK_DUPLICATE_STAKE,   //!< the block reuses the stake of another block we have connected
     BLOCK_HEADER_LOW_WORK    //!< the block header may be on a too-little-work chain
 };
 
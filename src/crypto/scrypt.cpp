@@ -27,7 +27,12 @@
  * online backup system.
  */
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <crypto/scrypt.h>
+#include <compat/cpuid.h>
 
 #include <stdlib.h>
 #include <stdint.h>
@@ -566,6 +571,91 @@ void scrypt_1024_1_1_256(const char *input, char *output)
     scrypt_1024_1_1_256_sp(input, output, scratchpad);
 }
 
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace scrypt_avx2
+{
+void Scrypt_8way(const char* input, char* output);
+}
+#endif
+
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace scrypt_avx512
+{
+void Scrypt_16way(const char* input, char* output);
+}
+#endif
+
+namespace {
+typedef void (*ScryptMultiFunction)(const char* input, char* output);
+
+ScryptMultiFunction Scrypt_8way = nullptr;
+ScryptMultiFunction Scrypt_16way = nullptr;
+
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+/** Return the OS-enabled XSAVE state components (XCR0). */
+uint32_t GetXCR0()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return a;
+}
+#endif
+} // namespace
+
+std::string ScryptAutoDetect()
+{
+    std::string ret = "standard";
+    Scrypt_8way = nullptr;
+    Scrypt_16way = nullptr;
+
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+    [[maybe_unused]] bool have_avx2 = false;
+    [[maybe_unused]] bool have_avx512 = false;
+
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        const uint32_t xcr0 = GetXCR0();
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        // YMM state, plus opmask and ZMM state for AVX-512
+        have_avx2 = (xcr0 & 0x06) == 0x06 && ((ebx >> 5) & 1);
+        have_avx512 = (xcr0 & 0xe6) == 0xe6 && ((ebx >> 16) & 1);
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2) {
+        Scrypt_8way = scrypt_avx2::Scrypt_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx512) {
+        Scrypt_16way = scrypt_avx512::Scrypt_16way;
+        ret += ",avx512(16way)";
+    }
+#endif
+#endif // defined(USE_ASM) && defined(HAVE_GETCPUID)
+
+    return ret;
+}
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count)
+{
+    if (Scrypt_16way) {
+        for (; count >= 16; count -= 16, input += 80 * 16, output += 32 * 16)
+            Scrypt_16way(input, output);
+    }
+    if (Scrypt_8way) {
+        for (; count >= 8; count -= 8, input += 80 * 8, output += 32 * 8)
+            Scrypt_8way(input, output);
+    }
+    for (; count > 0; --count, input += 80, output += 32)
+        scrypt_1024_1_1_256(input, output);
+}
+
 void SHA256(unsigned char* input, int len, unsigned char* output)
 {
     SHA256_CTX ctx;
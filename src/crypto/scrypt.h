@@ -3,12 +3,21 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/** Autodetect the best available multi-lane scrypt implementation.
+ *  Returns the name of the implementation. */
+std::string ScryptAutoDetect();
+
+/** Compute the scrypt hashes of count consecutive 80-byte inputs into count consecutive
+ *  32-byte outputs, several lanes at a time when ScryptAutoDetect() found a SIMD implementation. */
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count);
+
 #if defined(USE_SSE2)
 #include <string>
 #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
@@ -0,0 +1,141 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <attributes.h>
+#include <crypto/scrypt.h>
+
+#include <memory>
+
+namespace scrypt_avx2 {
+namespace {
+
+constexpr int LANES = 8;
+
+__m256i inline K(uint32_t x) { return _mm256_set1_epi32(x); }
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline RotL(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+
+/** Salsa20/8 core on eight independent states, one per 32-bit lane. */
+void ALWAYS_INLINE XorSalsa8(__m256i B[16], const __m256i Bx[16])
+{
+    __m256i x00, x01, x02, x03, x04, x05, x06, x07, x08, x09, x10, x11, x12, x13, x14, x15;
+
+    x00 = (B[ 0] = Xor(B[ 0], Bx[ 0]));
+    x01 = (B[ 1] = Xor(B[ 1], Bx[ 1]));
+    x02 = (B[ 2] = Xor(B[ 2], Bx[ 2]));
+    x03 = (B[ 3] = Xor(B[ 3], Bx[ 3]));
+    x04 = (B[ 4] = Xor(B[ 4], Bx[ 4]));
+    x05 = (B[ 5] = Xor(B[ 5], Bx[ 5]));
+    x06 = (B[ 6] = Xor(B[ 6], Bx[ 6]));
+    x07 = (B[ 7] = Xor(B[ 7], Bx[ 7]));
+    x08 = (B[ 8] = Xor(B[ 8], Bx[ 8]));
+    x09 = (B[ 9] = Xor(B[ 9], Bx[ 9]));
+    x10 = (B[10] = Xor(B[10], Bx[10]));
+    x11 = (B[11] = Xor(B[11], Bx[11]));
+    x12 = (B[12] = Xor(B[12], Bx[12]));
+    x13 = (B[13] = Xor(B[13], Bx[13]));
+    x14 = (B[14] = Xor(B[14], Bx[14]));
+    x15 = (B[15] = Xor(B[15], Bx[15]));
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        x04 = Xor(x04, RotL(Add(x00, x12),  7));  x09 = Xor(x09, RotL(Add(x05, x01),  7));
+        x14 = Xor(x14, RotL(Add(x10, x06),  7));  x03 = Xor(x03, RotL(Add(x15, x11),  7));
+
+        x08 = Xor(x08, RotL(Add(x04, x00),  9));  x13 = Xor(x13, RotL(Add(x09, x05),  9));
+        x02 = Xor(x02, RotL(Add(x14, x10),  9));  x07 = Xor(x07, RotL(Add(x03, x15),  9));
+
+        x12 = Xor(x12, RotL(Add(x08, x04), 13));  x01 = Xor(x01, RotL(Add(x13, x09), 13));
+        x06 = Xor(x06, RotL(Add(x02, x14), 13));  x11 = Xor(x11, RotL(Add(x07, x03), 13));
+
+        x00 = Xor(x00, RotL(Add(x12, x08), 18));  x05 = Xor(x05, RotL(Add(x01, x13), 18));
+        x10 = Xor(x10, RotL(Add(x06, x02), 18));  x15 = Xor(x15, RotL(Add(x11, x07), 18));
+
+        /* Operate on rows. */
+        x01 = Xor(x01, RotL(Add(x00, x03),  7));  x06 = Xor(x06, RotL(Add(x05, x04),  7));
+        x11 = Xor(x11, RotL(Add(x10, x09),  7));  x12 = Xor(x12, RotL(Add(x15, x14),  7));
+
+        x02 = Xor(x02, RotL(Add(x01, x00),  9));  x07 = Xor(x07, RotL(Add(x06, x05),  9));
+        x08 = Xor(x08, RotL(Add(x11, x10),  9));  x13 = Xor(x13, RotL(Add(x12, x15),  9));
+
+        x03 = Xor(x03, RotL(Add(x02, x01), 13));  x04 = Xor(x04, RotL(Add(x07, x06), 13));
+        x09 = Xor(x09, RotL(Add(x08, x11), 13));  x14 = Xor(x14, RotL(Add(x13, x12), 13));
+
+        x00 = Xor(x00, RotL(Add(x03, x02), 18));  x05 = Xor(x05, RotL(Add(x04, x07), 18));
+        x10 = Xor(x10, RotL(Add(x09, x08), 18));  x15 = Xor(x15, RotL(Add(x14, x13), 18));
+    }
+    B[ 0] = Add(B[ 0], x00);
+    B[ 1] = Add(B[ 1], x01);
+    B[ 2] = Add(B[ 2], x02);
+    B[ 3] = Add(B[ 3], x03);
+    B[ 4] = Add(B[ 4], x04);
+    B[ 5] = Add(B[ 5], x05);
+    B[ 6] = Add(B[ 6], x06);
+    B[ 7] = Add(B[ 7], x07);
+    B[ 8] = Add(B[ 8], x08);
+    B[ 9] = Add(B[ 9], x09);
+    B[10] = Add(B[10], x10);
+    B[11] = Add(B[11], x11);
+    B[12] = Add(B[12], x12);
+    B[13] = Add(B[13], x13);
+    B[14] = Add(B[14], x14);
+    B[15] = Add(B[15], x15);
+}
+
+} // namespace
+
+/** scrypt(1024, 1, 1) of eight 80-byte inputs. The PBKDF2 steps run per lane,
+ *  the ROMix core runs on all lanes at once with word k of every lane in one vector. */
+void Scrypt_8way(const char* input, char* output)
+{
+    alignas(32) uint32_t X[32][LANES];
+    uint8_t B[128];
+
+    for (int l = 0; l < LANES; ++l) {
+        const uint8_t* in = (const uint8_t*)input + 80 * l;
+        PBKDF2_SHA256(in, 80, in, 80, 1, B, 128);
+        for (int k = 0; k < 32; ++k)
+            X[k][l] = le32dec(&B[4 * k]);
+    }
+
+    __m256i Xv[32];
+    for (int k = 0; k < 32; ++k)
+        Xv[k] = _mm256_load_si256((const __m256i*)X[k]);
+
+    struct Row { __m256i words[32]; };
+    std::unique_ptr<Row[]> V{new Row[1024]};
+    for (int i = 0; i < 1024; ++i) {
+        for (int k = 0; k < 32; ++k)
+            V[i].words[k] = Xv[k];
+        XorSalsa8(&Xv[0], &Xv[16]);
+        XorSalsa8(&Xv[16], &Xv[0]);
+    }
+    // Every lane reads its own row j of V: word k of lane l lives at j * 32 * LANES + k * LANES + l.
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (int i = 0; i < 1024; ++i) {
+        const __m256i row = Add(_mm256_slli_epi32(_mm256_and_si256(Xv[16], K(1023)), 8), lane);
+        for (int k = 0; k < 32; ++k)
+            Xv[k] = Xor(Xv[k], _mm256_i32gather_epi32((const int*)V.get(), Add(row, K(k * LANES)), 4));
+        XorSalsa8(&Xv[0], &Xv[16]);
+        XorSalsa8(&Xv[16], &Xv[0]);
+    }
+
+    for (int k = 0; k < 32; ++k)
+        _mm256_store_si256((__m256i*)X[k], Xv[k]);
+
+    for (int l = 0; l < LANES; ++l) {
+        for (int k = 0; k < 32; ++k)
+            le32enc(&B[4 * k], X[k][l]);
+        PBKDF2_SHA256((const uint8_t*)input + 80 * l, 80, B, 128, 1, (uint8_t*)output + 32 * l, 32);
+    }
+}
+
+} // namespace scrypt_avx2
+
+#endif
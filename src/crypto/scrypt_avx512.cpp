@@ -0,0 +1,146 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX512
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <attributes.h>
+#include <crypto/scrypt.h>
+
+#include <memory>
+
+namespace scrypt_avx512 {
+namespace {
+
+constexpr int LANES = 16;
+
+__m512i inline K(uint32_t x) { return _mm512_set1_epi32(x); }
+__m512i inline Add(__m512i x, __m512i y) { return _mm512_add_epi32(x, y); }
+__m512i inline Xor(__m512i x, __m512i y) { return _mm512_xor_si512(x, y); }
+// The unmasked forms of some AVX-512 intrinsics trip -Wuninitialized on GCC 12 (GCC bug 105593),
+// so the masked forms are used with every lane selected.
+constexpr __mmask16 ALL = 0xffff;
+
+__m512i inline RotL(__m512i x, int n) { return _mm512_mask_rolv_epi32(x, ALL, x, K(n)); }
+
+/** Salsa20/8 core on sixteen independent states, one per 32-bit lane. */
+void ALWAYS_INLINE XorSalsa8(__m512i B[16], const __m512i Bx[16])
+{
+    __m512i x00, x01, x02, x03, x04, x05, x06, x07, x08, x09, x10, x11, x12, x13, x14, x15;
+
+    x00 = (B[ 0] = Xor(B[ 0], Bx[ 0]));
+    x01 = (B[ 1] = Xor(B[ 1], Bx[ 1]));
+    x02 = (B[ 2] = Xor(B[ 2], Bx[ 2]));
+    x03 = (B[ 3] = Xor(B[ 3], Bx[ 3]));
+    x04 = (B[ 4] = Xor(B[ 4], Bx[ 4]));
+    x05 = (B[ 5] = Xor(B[ 5], Bx[ 5]));
+    x06 = (B[ 6] = Xor(B[ 6], Bx[ 6]));
+    x07 = (B[ 7] = Xor(B[ 7], Bx[ 7]));
+    x08 = (B[ 8] = Xor(B[ 8], Bx[ 8]));
+    x09 = (B[ 9] = Xor(B[ 9], Bx[ 9]));
+    x10 = (B[10] = Xor(B[10], Bx[10]));
+    x11 = (B[11] = Xor(B[11], Bx[11]));
+    x12 = (B[12] = Xor(B[12], Bx[12]));
+    x13 = (B[13] = Xor(B[13], Bx[13]));
+    x14 = (B[14] = Xor(B[14], Bx[14]));
+    x15 = (B[15] = Xor(B[15], Bx[15]));
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        x04 = Xor(x04, RotL(Add(x00, x12),  7));  x09 = Xor(x09, RotL(Add(x05, x01),  7));
+        x14 = Xor(x14, RotL(Add(x10, x06),  7));  x03 = Xor(x03, RotL(Add(x15, x11),  7));
+
+        x08 = Xor(x08, RotL(Add(x04, x00),  9));  x13 = Xor(x13, RotL(Add(x09, x05),  9));
+        x02 = Xor(x02, RotL(Add(x14, x10),  9));  x07 = Xor(x07, RotL(Add(x03, x15),  9));
+
+        x12 = Xor(x12, RotL(Add(x08, x04), 13));  x01 = Xor(x01, RotL(Add(x13, x09), 13));
+        x06 = Xor(x06, RotL(Add(x02, x14), 13));  x11 = Xor(x11, RotL(Add(x07, x03), 13));
+
+        x00 = Xor(x00, RotL(Add(x12, x08), 18));  x05 = Xor(x05, RotL(Add(x01, x13), 18));
+        x10 = Xor(x10, RotL(Add(x06, x02), 18));  x15 = Xor(x15, RotL(Add(x11, x07), 18));
+
+        /* Operate on rows. */
+        x01 = Xor(x01, RotL(Add(x00, x03),  7));  x06 = Xor(x06, RotL(Add(x05, x04),  7));
+        x11 = Xor(x11, RotL(Add(x10, x09),  7));  x12 = Xor(x12, RotL(Add(x15, x14),  7));
+
+        x02 = Xor(x02, RotL(Add(x01, x00),  9));  x07 = Xor(x07, RotL(Add(x06, x05),  9));
+        x08 = Xor(x08, RotL(Add(x11, x10),  9));  x13 = Xor(x13, RotL(Add(x12, x15),  9));
+
+        x03 = Xor(x03, RotL(Add(x02, x01), 13));  x04 = Xor(x04, RotL(Add(x07, x06), 13));
+        x09 = Xor(x09, RotL(Add(x08, x11), 13));  x14 = Xor(x14, RotL(Add(x13, x12), 13));
+
+        x00 = Xor(x00, RotL(Add(x03, x02), 18));  x05 = Xor(x05, RotL(Add(x04, x07), 18));
+        x10 = Xor(x10, RotL(Add(x09, x08), 18));  x15 = Xor(x15, RotL(Add(x14, x13), 18));
+    }
+    B[ 0] = Add(B[ 0], x00);
+    B[ 1] = Add(B[ 1], x01);
+    B[ 2] = Add(B[ 2], x02);
+    B[ 3] = Add(B[ 3], x03);
+    B[ 4] = Add(B[ 4], x04);
+    B[ 5] = Add(B[ 5], x05);
+    B[ 6] = Add(B[ 6], x06);
+    B[ 7] = Add(B[ 7], x07);
+    B[ 8] = Add(B[ 8], x08);
+    B[ 9] = Add(B[ 9], x09);
+    B[10] = Add(B[10], x10);
+    B[11] = Add(B[11], x11);
+    B[12] = Add(B[12], x12);
+    B[13] = Add(B[13], x13);
+    B[14] = Add(B[14], x14);
+    B[15] = Add(B[15], x15);
+}
+
+} // namespace
+
+/** scrypt(1024, 1, 1) of sixteen 80-byte inputs. The PBKDF2 steps run per lane,
+ *  the ROMix core runs on all lanes at once with word k of every lane in one vector. */
+void Scrypt_16way(const char* input, char* output)
+{
+    alignas(64) uint32_t X[32][LANES];
+    uint8_t B[128];
+
+    for (int l = 0; l < LANES; ++l) {
+        const uint8_t* in = (const uint8_t*)input + 80 * l;
+        PBKDF2_SHA256(in, 80, in, 80, 1, B, 128);
+        for (int k = 0; k < 32; ++k)
+            X[k][l] = le32dec(&B[4 * k]);
+    }
+
+    __m512i Xv[32];
+    for (int k = 0; k < 32; ++k)
+        Xv[k] = _mm512_load_si512((const __m512i*)X[k]);
+
+    struct Row { __m512i words[32]; };
+    std::unique_ptr<Row[]> V{new Row[1024]};
+    for (int i = 0; i < 1024; ++i) {
+        for (int k = 0; k < 32; ++k)
+            V[i].words[k] = Xv[k];
+        XorSalsa8(&Xv[0], &Xv[16]);
+        XorSalsa8(&Xv[16], &Xv[0]);
+    }
+    // Every lane reads its own row j of V: word k of lane l lives at j * 32 * LANES + k * LANES + l.
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (int i = 0; i < 1024; ++i) {
+        const __m512i j = _mm512_and_si512(Xv[16], K(1023));
+        const __m512i row = Add(_mm512_mask_slli_epi32(j, ALL, j, 9), lane);
+        for (int k = 0; k < 32; ++k)
+            Xv[k] = Xor(Xv[k], _mm512_mask_i32gather_epi32(Xv[k], ALL, Add(row, K(k * LANES)), (const int*)V.get(), 4));
+        XorSalsa8(&Xv[0], &Xv[16]);
+        XorSalsa8(&Xv[16], &Xv[0]);
+    }
+
+    for (int k = 0; k < 32; ++k)
+        _mm512_store_si512((__m512i*)X[k], Xv[k]);
+
+    for (int l = 0; l < LANES; ++l) {
+        for (int k = 0; k < 32; ++k)
+            le32enc(&B[4 * k], X[k][l]);
+        PBKDF2_SHA256((const uint8_t*)input + 80 * l, 80, B, 128, 1, (uint8_t*)output + 32 * l, 32);
+    }
+}
+
+} // namespace scrypt_avx512
+
+#endif
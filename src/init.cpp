@@ -9,6 +9,7 @@
 
 #include <init.h>
 
+#include <kernel/blockmanager_opts.h>
 #include <kernel/checks.h>
 #include <kernel/mempool_persist.h>
 #include <kernel/validation_cache_sizes.h>
@@ -53,6 +54,7 @@
 #include <node/mempool_persist_args.h>
 #include <node/miner.h>
 #include <node/peerman_args.h>
+#include <node/stake_weight.h>
 #include <node/validation_cache_args.h>
 #include <policy/feerate.h>
 #include <policy/fees.h>
@@ -297,6 +299,7 @@ void Shutdown(NodeContext& node)
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (node.peerman) UnregisterValidationInterface(node.peerman.get());
+    if (node.stake_weight_estimator) UnregisterValidationInterface(node.stake_weight_estimator.get());
     if (node.connman) node.connman->Stop();
 
     StopTorControl();
@@ -310,6 +313,7 @@ void Shutdown(NodeContext& node)
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     node.peerman.reset();
+    node.stake_weight_estimator.reset();
     node.connman.reset();
     node.banman.reset();
     node.addrman.reset();
@@ -353,12 +357,16 @@ void Shutdown(NodeContext& node)
 
     if (node.chainman) {
         LOCK(cs_main);
+        bool flushed{false};
         for (Chainstate* chainstate : node.chainman->GetAll()) {
             if (chainstate->CanFlushToDisk()) {
                 chainstate->ForceFlushStateToDisk();
                 chainstate->ResetCoinsViews();
+                flushed = true;
             }
         }
+        // A block index that did not finish loading must not be snapshotted
+        if (flushed && node.chainman->ActiveTip()) node.chainman->m_blockman.WriteBlockIndexSnapshot(*node.chainman->ActiveTip());
     }
     for (const auto& client : node.chain_clients) {
         client->stop();
@@ -460,6 +468,7 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-alertnotify=<cmd>", "Execute command when an alert is raised (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     argsman.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s, signet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex(), signetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-blockindexsnapshot", strprintf("Write the block index to a snapshot file at shutdown, to load it faster at the next startup (default: %u)", kernel::DEFAULT_BLOCK_INDEX_SNAPSHOT), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     argsman.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -490,6 +499,7 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-reindex", "If enabled, wipe chain state and block index, and rebuild them from blk*.dat files on disk. Also wipe and rebuild other optional indexes that are active. If an assumeutxo snapshot was loaded, its chainstate will be wiped as well. The snapshot can then be reloaded via RPC.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-reindex-chainstate", "If enabled, wipe chain state, and rebuild it from blk*.dat files on disk. If an assumeutxo snapshot was loaded, its chainstate will be wiped as well. The snapshot can then be reloaded via RPC.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-settings=<file>", strprintf("Specify path to dynamic settings data file. Can be disabled with -nosettings. File is written at runtime and not meant to be edited by users (use %s instead for custom settings). Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME, BITCOIN_SETTINGS_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-stakeweightwindow=<n>", strprintf("Estimate the network stake weight over the last <n> proof-of-stake blocks, shown by getstakinginfo. Can be specified multiple times. The %u block window of netstakeweight is always kept (1 to %u, default: %s)", node::DEFAULT_STAKE_WEIGHT_WINDOW, node::MAX_STAKE_WEIGHT_WINDOW, Join(node::DEFAULT_STAKE_WEIGHT_WINDOWS, ", ", [](size_t blocks) { return ToString(blocks); })), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     argsman.AddArg("-startupnotify=<cmd>", "Execute command on startup.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-shutdownnotify=<cmd>", "Execute command immediately before beginning shutdown. The need for shutdown may be urgent, so be careful not to delay it long (if the command doesn't require interaction with the server, consider having it fork into the background).", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -1621,6 +1631,26 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
                                      *node.mempool, peerman_opts);
     RegisterValidationInterface(node.peerman.get());
 
+    std::vector<size_t> stake_weight_windows{node::DEFAULT_STAKE_WEIGHT_WINDOW};
+    if (args.IsArgSet("-stakeweightwindow")) {
+        for (const std::string& window : args.GetArgs("-stakeweightwindow")) {
+            const auto blocks{ToIntegral<size_t>(window)};
+            if (!blocks || *blocks < 1 || *blocks > node::MAX_STAKE_WEIGHT_WINDOW) {
+                return InitError(strprintf(_("Invalid -stakeweightwindow value '%s' (1 to %u)."), window, node::MAX_STAKE_WEIGHT_WINDOW));
+            }
+            stake_weight_windows.push_back(*blocks);
+        }
+    } else {
+        stake_weight_windows.insert(stake_weight_windows.end(), node::DEFAULT_STAKE_WEIGHT_WINDOWS.begin(), node::DEFAULT_STAKE_WEIGHT_WINDOWS.end());
+    }
+    std::sort(stake_weight_windows.begin(), stake_weight_windows.end());
+    stake_weight_windows.erase(std::unique(stake_weight_windows.begin(), stake_weight_windows.end()), stake_weight_windows.end());
+
+    assert(!node.stake_weight_estimator);
+    node.stake_weight_estimator = std::make_unique<node::StakeWeightEstimator>(chainparams.GetConsensus().nStakeTimestampMask, stake_weight_windows);
+    WITH_LOCK(cs_main, node.stake_weight_estimator->Init(chainman.ActiveTip()));
+    RegisterValidationInterface(node.stake_weight_estimator.get());
+
     // ********************************************************* Step 8: start indexers
 
     if (args.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
@@ -207,6 +207,13 @@ public:
     //! the specified block hash are verified.
     virtual double guessVerificationProgress(const uint256& block_hash) = 0;
 
+    //! Kernels tried per second by the network over the last window
+    //! proof-of-stake blocks of the active chain.
+    virtual double getPoSKernelPS(size_t window) = 0;
+
+    //! Windows, in proof-of-stake blocks, with a network stake weight estimate.
+    virtual std::vector<size_t> getPoSKernelPSWindows() = 0;
+
     //! Return true if data is available for all blocks in the specified range
     //! of blocks. This checks all blocks that are ancestors of block_hash in
     //! the height range from min_height to max_height, inclusive.
@@ -383,6 +390,9 @@ public:
     //! Stop staking.
     virtual void stopStake(wallet::CWallet& wallet) = 0;
 
+    //! Wake the staking thread, e.g. after the wallet's stakeable coins changed.
+    virtual void notifyStake() = 0;
+
     //! Get stake weight.
     virtual uint64_t getStakeWeight(const wallet::CWallet& wallet) = 0;
 
@@ -14,6 +14,8 @@ class CChainParams;
 
 namespace kernel {
 
+static constexpr bool DEFAULT_BLOCK_INDEX_SNAPSHOT{true};
+
 /**
  * An options struct for `BlockManager`, more ergonomically referred to as
  * `BlockManager::Options` due to the using-declaration in `BlockManager`.
@@ -22,6 +24,8 @@ struct BlockManagerOpts {
     const CChainParams& chainparams;
     uint64_t prune_target{0};
     bool fast_prune{false};
+    //! Write the block index to a snapshot file at shutdown, and load it from there at startup
+    bool block_index_snapshot{DEFAULT_BLOCK_INDEX_SNAPSHOT};
     const fs::path blocks_dir;
     Notifications& notifications;
 };
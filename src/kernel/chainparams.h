@@ -59,6 +59,10 @@ struct AssumeutxoData {
     //! The hash of the base block for this snapshot. Used to refer to assumeutxo data
     //! prior to having a loaded blockindex.
     uint256 blockhash;
+
+    //! The expected stake modifier of the base block, carried by the snapshot but
+    //! not covered by hash_serialized. Snapshots are refused when it is null.
+    uint256 stake_modifier{};
 };
 
 /**
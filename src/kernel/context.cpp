@@ -4,6 +4,7 @@
 
 #include <kernel/context.h>
 
+#include <crypto/scrypt.h>
 #include <crypto/sha256.h>
 #include <key.h>
 #include <logging.h>
@@ -22,6 +23,8 @@ Context::Context()
     g_context = this;
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string scrypt_algo = ScryptAutoDetect();
+    LogPrintf("Using the '%s' scrypt implementation\n", scrypt_algo);
     RandomInit();
     ECC_Start();
 }
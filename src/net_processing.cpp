@@ -2003,6 +2003,10 @@ bool PeerManagerImpl::MaybePunishNodeForBlock(NodeId nodeid, const BlockValidati
         // TODO: Handle this much more gracefully (10 DoS points is super arbitrary)
         if (peer) Misbehaving(*peer, 10, message);
         return true;
+    case BlockValidationResult::BLOCK_DUPLICATE_STAKE:
+        // Honest peers can relay the losing side of a stake race, so this is not an instant ban
+        if (peer) Misbehaving(*peer, 10, message);
+        return true;
     case BlockValidationResult::BLOCK_HEADER_SYNC:
         if (peer) Misbehaving(*peer, 1, message);
         return true;
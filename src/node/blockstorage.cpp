@@ -7,6 +7,7 @@
 #include <chain.h>
 #include <clientversion.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <dbwrapper.h>
 #include <flatfile.h>
 #include <hash.h>
@@ -15,6 +16,7 @@
 #include <kernel/messagestartchars.h>
 #include <logging.h>
 #include <pow.h>
+#include <random.h>
 #include <reverse_iterator.h>
 #include <signet.h>
 #include <streams.h>
@@ -22,6 +24,7 @@
 #include <undo.h>
 #include <util/batchpriority.h>
 #include <util/fs.h>
+#include <util/fs_helpers.h>
 #include <util/signalinterrupt.h>
 #include <util/strencodings.h>
 #include <util/translation.h>
@@ -30,7 +33,14 @@
 #include <wallet/wallet.h>
 #endif
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include <map>
+#include <thread>
 #include <unordered_map>
 
 namespace kernel {
@@ -39,6 +49,7 @@ static constexpr uint8_t DB_BLOCK_INDEX{'b'};
 static constexpr uint8_t DB_FLAG{'F'};
 static constexpr uint8_t DB_REINDEX_FLAG{'R'};
 static constexpr uint8_t DB_LAST_BLOCK{'l'};
+static constexpr uint8_t DB_BLOCK_INDEX_SNAPSHOT{'s'};
 // Keys used in previous version that might still be found in the DB:
 // BlockTreeDB::DB_TXINDEX_BLOCK{'T'};
 // BlockTreeDB::DB_TXINDEX{'t'}
@@ -78,9 +89,28 @@ bool BlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFi
     for (const CBlockIndex* bi : blockinfo) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, bi->GetBlockHash()), CDiskBlockIndex{bi});
     }
+    // The snapshot file only matches the database it was written from
+    batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
     return WriteBatch(batch, true);
 }
 
+bool BlockTreeDB::ReadBlockIndex(const uint256& hash, CDiskBlockIndex& index)
+{
+    return Read(std::make_pair(DB_BLOCK_INDEX, hash), index);
+}
+
+bool BlockTreeDB::WriteBlockIndexSnapshotId(const uint256& id)
+{
+    return Write(DB_BLOCK_INDEX_SNAPSHOT, id, /*fSync=*/true);
+}
+
+std::optional<uint256> BlockTreeDB::ReadBlockIndexSnapshotId()
+{
+    uint256 id;
+    if (!Read(DB_BLOCK_INDEX_SNAPSHOT, id)) return std::nullopt;
+    return id;
+}
+
 bool BlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? uint8_t{'1'} : uint8_t{'0'});
@@ -229,6 +259,7 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block, CBlockInde
     }
     if (fSetAsProofOfStake)
         pindexNew->SetProofOfStake();
+    pindexNew->BuildPrevOtherType();
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
@@ -257,11 +288,317 @@ CBlockIndex* BlockManager::InsertBlockIndex(const uint256& hash)
     return pindex;
 }
 
-bool BlockManager::LoadBlockIndex(const std::optional<uint256>& snapshot_blockhash)
+/**
+ * The block index snapshot holds every entry of the block index in a fixed
+ * size record, sorted by height, so that it loads without a database
+ * iteration or a sort. A record refers to its parent by record number, and
+ * the records are checksummed in chunks, which are decoded in parallel.
+ */
+static constexpr std::array<uint8_t, 4> BLOCK_INDEX_SNAPSHOT_MAGIC{'b', 'i', 'd', 'x'};
+static constexpr uint32_t BLOCK_INDEX_SNAPSHOT_VERSION{2};
+static constexpr size_t BLOCK_INDEX_RECORD_SIZE{144};
+static constexpr uint32_t NO_PREV_RECORD{std::numeric_limits<uint32_t>::max()};
+static constexpr unsigned int MAX_BLOCK_INDEX_SNAPSHOT_THREADS{8};
+
+struct BlockIndexSnapshotHeader {
+    std::array<uint8_t, 4> magic{BLOCK_INDEX_SNAPSHOT_MAGIC};
+    uint32_t version{BLOCK_INDEX_SNAPSHOT_VERSION};
+    //! Matched against the database, which only keeps the id of the last snapshot until it is written to
+    uint256 id;
+    //! Best block of the coins database, which an older version may have moved without unsetting the id
+    uint256 best_block;
+    int best_height{0};
+    uint64_t count{0};
+    int last_file{0};
+    CBlockFileInfo last_file_info;
+    //! MurmurHash3 of each chunk of records, seeded with the chunk number. Written
+    //! over once the records are, so that they are not all held in memory.
+    std::vector<uint32_t> checksums;
+
+    SERIALIZE_METHODS(BlockIndexSnapshotHeader, obj) { READWRITE(obj.magic, obj.version, obj.id, obj.best_block, obj.best_height, obj.count, obj.last_file, obj.last_file_info, obj.checksums); }
+};
+
+static void EncodeBlockIndexRecord(const CBlockIndex& index, uint32_t prev_record, unsigned char* record) EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
+{
+    // Positions are kept only as far as the database keeps them, so that both
+    // load to the same entries
+    const bool have_data{(index.nStatus & BLOCK_HAVE_DATA) != 0};
+    const bool have_undo{(index.nStatus & BLOCK_HAVE_UNDO) != 0};
+    std::memcpy(record, index.GetBlockHash().begin(), 32);
+    WriteLE32(record + 32, prev_record);
+    WriteLE32(record + 36, uint32_t(index.nHeight));
+    WriteLE32(record + 40, index.nStatus);
+    WriteLE32(record + 44, index.nTx);
+    WriteLE32(record + 48, uint32_t((have_data || have_undo) ? index.nFile : 0));
+    WriteLE32(record + 52, have_data ? index.nDataPos : 0);
+    WriteLE32(record + 56, have_undo ? index.nUndoPos : 0);
+    WriteLE32(record + 60, uint32_t(index.nVersion));
+    std::memcpy(record + 64, index.hashMerkleRoot.begin(), 32);
+    WriteLE32(record + 96, index.nTime);
+    WriteLE32(record + 100, index.nBits);
+    WriteLE32(record + 104, index.nNonce);
+    WriteLE32(record + 108, index.nFlags);
+    std::memcpy(record + 112, index.nStakeModifier.begin(), 32);
+}
+
+//! Decode all but the hash of a record, and return the record number of the parent.
+//! The entries are only decoded while the loading thread holds cs_main for them.
+static uint32_t DecodeBlockIndexRecord(const unsigned char* record, CBlockIndex& index) NO_THREAD_SAFETY_ANALYSIS
+{
+    index.nHeight = int(ReadLE32(record + 36));
+    index.nStatus = ReadLE32(record + 40);
+    index.nTx = ReadLE32(record + 44);
+    index.nFile = int(ReadLE32(record + 48));
+    index.nDataPos = ReadLE32(record + 52);
+    index.nUndoPos = ReadLE32(record + 56);
+    index.nVersion = int32_t(ReadLE32(record + 60));
+    std::memcpy(index.hashMerkleRoot.begin(), record + 64, 32);
+    index.nTime = ReadLE32(record + 96);
+    index.nBits = ReadLE32(record + 100);
+    index.nNonce = ReadLE32(record + 104);
+    index.nFlags = ReadLE32(record + 108);
+    std::memcpy(index.nStakeModifier.begin(), record + 112, 32);
+    return ReadLE32(record + 32);
+}
+
+//! Call fn for each number in [0, count), on up to max_threads threads
+template <typename Fn>
+static void ParallelFor(size_t count, unsigned int max_threads, Fn fn)
+{
+    std::atomic<size_t> next{0};
+    const auto work{[&] {
+        for (size_t i; (i = next++) < count;) fn(i);
+    }};
+    std::vector<std::thread> threads;
+    for (size_t i{1}; i < std::min<size_t>(count, max_threads); ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+static uint256 BlockFileInfoHash(const CBlockFileInfo& info)
+{
+    return (HashWriter{} << info).GetHash();
+}
+
+bool BlockManager::WriteBlockIndexSnapshot(const CBlockIndex& tip)
+{
+    AssertLockHeld(::cs_main);
+    if (!m_opts.block_index_snapshot || !m_block_tree_db || m_block_index.empty()) return false;
+    // Only what the database holds can be checked against it at startup
+    if (!m_dirty_blockindex.empty() || !m_dirty_fileinfo.empty()) return false;
+
+    BlockIndexSnapshotHeader header;
+    header.id = GetRandHash();
+    header.best_block = tip.GetBlockHash();
+    header.best_height = tip.nHeight;
+    header.count = m_block_index.size();
+    if (header.count >= NO_PREV_RECORD) return false;
+    {
+        LOCK(cs_LastBlockFile);
+        header.last_file = MaxBlockfileNum();
+        if (size_t(header.last_file) < m_blockfile_info.size()) header.last_file_info = m_blockfile_info[header.last_file];
+    }
+
+    std::vector<CBlockIndex*> sorted_by_height{GetAllBlockIndices()};
+    std::sort(sorted_by_height.begin(), sorted_by_height.end(), CBlockIndexHeightOnlyComparator());
+    // The parent is among the entries one block lower, of which there are
+    // more than one only at forks
+    const auto prev_record{[&](const CBlockIndex& index) {
+        if (!index.pprev) return NO_PREV_RECORD;
+        const auto lower{std::lower_bound(sorted_by_height.begin(), sorted_by_height.end(), index.pprev->nHeight,
+                                          [](const CBlockIndex* pindex, int height) { return pindex->nHeight < height; })};
+        return uint32_t(std::find(lower, sorted_by_height.end(), index.pprev) - sorted_by_height.begin());
+    }};
+    header.checksums.resize((header.count + BLOCK_INDEX_RECORDS_PER_CHUNK - 1) / BLOCK_INDEX_RECORDS_PER_CHUNK);
+
+    const fs::path path{m_opts.blocks_dir / BLOCK_INDEX_SNAPSHOT_FILENAME};
+    const fs::path path_tmp{path + ".new"};
+    AutoFile file{fsbridge::fopen(path_tmp, "wb")};
+    if (file.IsNull()) {
+        return error("%s: failed to open file %s", __func__, fs::PathToString(path_tmp));
+    }
+    try {
+        file << header;
+        std::vector<unsigned char> chunk;
+        for (size_t begin{0}, n{0}; begin < sorted_by_height.size(); begin += BLOCK_INDEX_RECORDS_PER_CHUNK, ++n) {
+            const size_t end{std::min(sorted_by_height.size(), begin + BLOCK_INDEX_RECORDS_PER_CHUNK)};
+            chunk.resize((end - begin) * BLOCK_INDEX_RECORD_SIZE);
+            for (size_t i{begin}; i < end; ++i) {
+                EncodeBlockIndexRecord(*sorted_by_height[i], prev_record(*sorted_by_height[i]), &chunk[(i - begin) * BLOCK_INDEX_RECORD_SIZE]);
+            }
+            header.checksums[n] = MurmurHash3(uint32_t(n), chunk);
+            file.write(MakeByteSpan(chunk));
+        }
+        // The header keeps its size, with the checksums filled in
+        if (std::fseek(file.Get(), 0, SEEK_SET) != 0) throw std::ios_base::failure("failed to seek to the header");
+        file << header;
+    } catch (const std::exception& e) {
+        file.fclose();
+        fs::remove(path_tmp);
+        return error("%s: failed to write block index snapshot: %s", __func__, e.what());
+    }
+    if (!FileCommit(file.Get()) || file.fclose() != 0 || !RenameOver(path_tmp, path)) {
+        fs::remove(path_tmp);
+        return error("%s: failed to write block index snapshot", __func__);
+    }
+    if (!m_block_tree_db->WriteBlockIndexSnapshotId(header.id)) {
+        return error("%s: failed to write block index snapshot id", __func__);
+    }
+    LogPrintf("Wrote block index snapshot of %u entries\n", header.count);
+    return true;
+}
+
+bool BlockManager::LoadBlockIndexSnapshot(const uint256& best_block, std::vector<CBlockIndex*>& sorted_by_height)
+{
+    AssertLockHeld(cs_main);
+    if (!m_opts.block_index_snapshot || !m_block_index.empty() || best_block.IsNull()) return false;
+    const std::optional<uint256> id{m_block_tree_db->ReadBlockIndexSnapshotId()};
+    if (!id) return false;
+    AutoFile file{fsbridge::fopen(m_opts.blocks_dir / BLOCK_INDEX_SNAPSHOT_FILENAME, "rb")};
+    if (file.IsNull()) return false;
+
+    bool loaded{false};
+    try {
+        loaded = ReadBlockIndexSnapshot(file, *id, best_block, sorted_by_height);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to read the block index snapshot: %s\n", e.what());
+    }
+    if (!loaded) {
+        m_block_index.clear();
+        sorted_by_height.clear();
+        LogPrintf("Ignoring the block index snapshot, loading the block index from the database\n");
+    }
+    return loaded;
+}
+
+bool BlockManager::ReadBlockIndexSnapshot(AutoFile& file, const uint256& id, const uint256& best_block, std::vector<CBlockIndex*>& sorted_by_height)
 {
-    if (!m_block_tree_db->LoadBlockIndexGuts(
-            GetConsensus(), [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }, m_interrupt)) {
+    AssertLockHeld(cs_main);
+    const auto invalid{[](const std::string& reason) {
+        LogPrintf("Block index snapshot %s\n", reason);
         return false;
+    }};
+
+    BlockIndexSnapshotHeader header;
+    file >> header;
+    if (header.magic != BLOCK_INDEX_SNAPSHOT_MAGIC || header.version != BLOCK_INDEX_SNAPSHOT_VERSION) return invalid("has an unknown format");
+    if (header.id != id) return invalid("does not match the database");
+    if (header.best_block != best_block) return invalid("does not match the best block");
+    const size_t count{header.count};
+    if (count == 0 || count >= NO_PREV_RECORD ||
+        header.checksums.size() != (count + BLOCK_INDEX_RECORDS_PER_CHUNK - 1) / BLOCK_INDEX_RECORDS_PER_CHUNK) {
+        return invalid("is malformed");
+    }
+    int last_file{0};
+    CBlockFileInfo last_file_info;
+    m_block_tree_db->ReadLastBlockFile(last_file);
+    m_block_tree_db->ReadBlockFileInfo(last_file, last_file_info);
+    if (header.last_file != last_file || BlockFileInfoHash(header.last_file_info) != BlockFileInfoHash(last_file_info)) {
+        return invalid("does not match the block files of the database");
+    }
+
+    const unsigned int threads{std::clamp(std::thread::hardware_concurrency(), 1U, MAX_BLOCK_INDEX_SNAPSHOT_THREADS)};
+    m_block_index.reserve(count);
+    sorted_by_height.resize(count);
+    std::vector<unsigned char> batch;
+    // One chunk per thread at a time, so that no more than that is buffered
+    for (size_t batch_begin{0}; batch_begin < count; batch_begin += threads * BLOCK_INDEX_RECORDS_PER_CHUNK) {
+        if (m_interrupt) return false;
+        const size_t batch_end{std::min(count, batch_begin + threads * BLOCK_INDEX_RECORDS_PER_CHUNK)};
+        batch.resize((batch_end - batch_begin) * BLOCK_INDEX_RECORD_SIZE);
+        file.read(MakeWritableByteSpan(batch));
+
+        // Only the insertions into the map are serial
+        for (size_t i{batch_begin}; i < batch_end; ++i) {
+            uint256 hash;
+            std::memcpy(hash.begin(), &batch[(i - batch_begin) * BLOCK_INDEX_RECORD_SIZE], 32);
+            const auto [it, inserted]{m_block_index.try_emplace(hash)};
+            if (!inserted) return invalid("has a duplicate entry");
+            it->second.phashBlock = &it->first;
+            sorted_by_height[i] = &it->second;
+        }
+
+        // Parents come before their children, so that they are already in
+        // sorted_by_height, but may not have been decoded yet
+        std::atomic<bool> valid{true};
+        ParallelFor((batch_end - batch_begin + BLOCK_INDEX_RECORDS_PER_CHUNK - 1) / BLOCK_INDEX_RECORDS_PER_CHUNK, threads, [&](size_t n) {
+            const size_t begin{batch_begin + n * BLOCK_INDEX_RECORDS_PER_CHUNK};
+            const size_t end{std::min(batch_end, begin + BLOCK_INDEX_RECORDS_PER_CHUNK)};
+            const Span<const unsigned char> records{Span{batch}.subspan((begin - batch_begin) * BLOCK_INDEX_RECORD_SIZE, (end - begin) * BLOCK_INDEX_RECORD_SIZE)};
+            if (MurmurHash3(uint32_t(begin / BLOCK_INDEX_RECORDS_PER_CHUNK), records) != header.checksums[begin / BLOCK_INDEX_RECORDS_PER_CHUNK]) {
+                valid = false;
+                return;
+            }
+            for (size_t i{begin}; i < end; ++i) {
+                const uint32_t prev{DecodeBlockIndexRecord(&records[(i - begin) * BLOCK_INDEX_RECORD_SIZE], *sorted_by_height[i])};
+                if (prev == NO_PREV_RECORD) continue;
+                if (prev >= i) {
+                    valid = false;
+                    return;
+                }
+                sorted_by_height[i]->pprev = sorted_by_height[prev];
+            }
+        });
+        if (!valid) return invalid("is corrupted");
+    }
+    if (std::fgetc(file.Get()) != EOF) return invalid("is malformed");
+
+    // With every entry decoded, check the heights against the parents and the
+    // order of the records
+    std::atomic<bool> valid{true};
+    ParallelFor(header.checksums.size(), threads, [&](size_t n) {
+        const size_t begin{n * BLOCK_INDEX_RECORDS_PER_CHUNK};
+        const size_t end{std::min(count, begin + BLOCK_INDEX_RECORDS_PER_CHUNK)};
+        for (size_t i{begin}; i < end; ++i) {
+            const CBlockIndex& index{*sorted_by_height[i]};
+            if ((index.pprev && index.pprev->nHeight != index.nHeight - 1) ||
+                (i > 0 && sorted_by_height[i - 1]->nHeight > index.nHeight)) {
+                valid = false;
+                return;
+            }
+        }
+    });
+    if (!valid) return invalid("is corrupted");
+
+    // Spot check the first entry of every chunk and the last entry against the database
+    const auto matches_database{[&](const CBlockIndex& index) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+        CDiskBlockIndex disk_index;
+        if (!m_block_tree_db->ReadBlockIndex(index.GetBlockHash(), disk_index) ||
+            disk_index.hashPrev != (index.pprev ? index.pprev->GetBlockHash() : uint256{})) {
+            return false;
+        }
+        disk_index.phashBlock = index.phashBlock;
+        std::array<unsigned char, BLOCK_INDEX_RECORD_SIZE> disk_record, record;
+        EncodeBlockIndexRecord(disk_index, 0, disk_record.data());
+        EncodeBlockIndexRecord(index, 0, record.data());
+        return disk_record == record;
+    }};
+    for (size_t i{0}; i < count; i += BLOCK_INDEX_RECORDS_PER_CHUNK) {
+        if (!matches_database(*sorted_by_height[i])) return invalid("does not match the database");
+    }
+    if (!matches_database(*sorted_by_height.back())) return invalid("does not match the database");
+    const CBlockIndex* best{LookupBlockIndex(header.best_block)};
+    if (!best || best->nHeight != header.best_height || !matches_database(*best)) return invalid("does not match the best block");
+
+    LogPrintf("Loaded block index snapshot of %u entries\n", count);
+    return true;
+}
+
+bool BlockManager::LoadBlockIndex(const std::optional<uint256>& snapshot_blockhash, const uint256& best_block)
+{
+    std::vector<CBlockIndex*> vSortedByHeight;
+    if (!LoadBlockIndexSnapshot(best_block, vSortedByHeight)) {
+        if (!m_block_tree_db->LoadBlockIndexGuts(
+                GetConsensus(), [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }, m_interrupt)) {
+            return false;
+        }
+        vSortedByHeight = GetAllBlockIndices();
+        std::sort(vSortedByHeight.begin(), vSortedByHeight.end(),
+                  CBlockIndexHeightOnlyComparator());
     }
 
     if (snapshot_blockhash) {
@@ -289,10 +626,6 @@ bool BlockManager::LoadBlockIndex(const std::optional<uint256>& snapshot_blockha
     Assert(m_snapshot_height.has_value() == snapshot_blockhash.has_value());
 
     // Calculate nChainWork
-    std::vector<CBlockIndex*> vSortedByHeight{GetAllBlockIndices()};
-    std::sort(vSortedByHeight.begin(), vSortedByHeight.end(),
-              CBlockIndexHeightOnlyComparator());
-
     CBlockIndex* previous_index{nullptr};
     for (CBlockIndex* pindex : vSortedByHeight) {
         if (m_interrupt) return false;
@@ -328,6 +661,7 @@ bool BlockManager::LoadBlockIndex(const std::optional<uint256>& snapshot_blockha
         }
         if (pindex->pprev) {
             pindex->BuildSkip();
+            pindex->BuildPrevOtherType();
         }
     }
 
@@ -356,9 +690,9 @@ bool BlockManager::WriteBlockIndexDB()
     return true;
 }
 
-bool BlockManager::LoadBlockIndexDB(const std::optional<uint256>& snapshot_blockhash)
+bool BlockManager::LoadBlockIndexDB(const std::optional<uint256>& snapshot_blockhash, const uint256& best_block)
 {
-    if (!LoadBlockIndex(snapshot_blockhash)) {
+    if (!LoadBlockIndex(snapshot_blockhash, best_block)) {
         return false;
     }
     int max_blockfile_num{0};
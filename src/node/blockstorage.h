@@ -23,12 +23,14 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+class AutoFile;
 class BlockValidationState;
 class CAutoFile;
 class CBlock;
@@ -58,6 +60,10 @@ public:
     void ReadReindexing(bool& fReindexing);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
+    bool ReadBlockIndex(const uint256& hash, CDiskBlockIndex& index);
+    //! Id of the block index snapshot file matching the database, unset by any later write
+    bool WriteBlockIndexSnapshotId(const uint256& id);
+    std::optional<uint256> ReadBlockIndexSnapshotId();
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, const util::SignalInterrupt& interrupt)
         EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 };
@@ -73,6 +79,11 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 
+/** Block index snapshot file, in the blocks directory */
+static constexpr auto BLOCK_INDEX_SNAPSHOT_FILENAME{"index.snapshot"};
+/** Number of block index snapshot records that are checksummed and decoded together */
+static constexpr size_t BLOCK_INDEX_RECORDS_PER_CHUNK{1 << 16};
+
 /** Size of header written by WriteBlockToDisk before a serialized CBlock */
 static constexpr size_t BLOCK_SERIALIZATION_HEADER_SIZE = std::tuple_size_v<MessageStartChars> + sizeof(unsigned int);
 
@@ -146,7 +157,17 @@ private:
      * per index entry (nStatus, nChainWork, nTimeMax, etc.) as well as peripheral
      * collections like m_dirty_blockindex.
      */
-    bool LoadBlockIndex(const std::optional<uint256>& snapshot_blockhash)
+    bool LoadBlockIndex(const std::optional<uint256>& snapshot_blockhash, const uint256& best_block)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /**
+     * Load the block index from the snapshot file written at the last
+     * shutdown, if it still matches the database and was written at
+     * best_block. Return the entries sorted by height, and false with an empty
+     * m_block_index otherwise.
+     */
+    bool LoadBlockIndexSnapshot(const uint256& best_block, std::vector<CBlockIndex*>& sorted_by_height)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool ReadBlockIndexSnapshot(AutoFile& file, const uint256& id, const uint256& best_block, std::vector<CBlockIndex*>& sorted_by_height)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     /** Return false if block file or undo file flushing fails. */
@@ -259,8 +280,18 @@ public:
     std::unique_ptr<BlockTreeDB> m_block_tree_db GUARDED_BY(::cs_main);
 
     bool WriteBlockIndexDB() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
-    bool LoadBlockIndexDB(const std::optional<uint256>& snapshot_blockhash)
+    /**
+     * Load the block index, from the snapshot file when it was written with
+     * best_block, the best block of the coins database, as the tip.
+     */
+    bool LoadBlockIndexDB(const std::optional<uint256>& snapshot_blockhash, const uint256& best_block = {})
         EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+    /**
+     * Write the block index to the snapshot file loaded by the next startup,
+     * once it has been flushed to the database with tip as the best block of
+     * the coins database. Return whether it was written.
+     */
+    bool WriteBlockIndexSnapshot(const CBlockIndex& tip) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block, CBlockIndex*& best_header, bool fSetAsProofOfStake) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Create a new block index entry for a given block hash */
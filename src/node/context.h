@@ -38,6 +38,7 @@ class WalletLoader;
 
 namespace node {
 class KernelNotifications;
+class StakeWeightEstimator;
 
 //! NodeContext struct containing references to chain state and connection
 //! state.
@@ -72,6 +73,7 @@ struct NodeContext {
     std::unique_ptr<CScheduler> scheduler;
     std::function<void()> rpc_interruption_point = [] {};
     std::unique_ptr<KernelNotifications> notifications;
+    std::unique_ptr<StakeWeightEstimator> stake_weight_estimator;
     std::atomic<int> exit_status{EXIT_SUCCESS};
 
     //! Declare default constructor and destructor that are not inline, so code
@@ -29,6 +29,7 @@
 #include <node/context.h>
 #include <node/interface_ui.h>
 #include <node/mini_miner.h>
+#include <node/stake_weight.h>
 #include <node/transaction.h>
 #include <policy/feerate.h>
 #include <policy/fees.h>
@@ -373,7 +374,7 @@ public:
     }
     double getPoSKernelPS() override
     {
-        return GetPoSKernelPS(chainman());
+        return m_context->stake_weight_estimator ? m_context->stake_weight_estimator->GetKernelsPS() : 0;
     }
     std::unique_ptr<Handler> handleInitMessage(InitMessageFn fn) override
     {
@@ -647,6 +648,14 @@ public:
         LOCK(::cs_main);
         return GuessVerificationProgress(chainman().GetParams().TxData(), chainman().m_blockman.LookupBlockIndex(block_hash));
     }
+    double getPoSKernelPS(size_t window) override
+    {
+        return m_node.stake_weight_estimator ? m_node.stake_weight_estimator->GetKernelsPS(window) : 0;
+    }
+    std::vector<size_t> getPoSKernelPSWindows() override
+    {
+        return m_node.stake_weight_estimator ? m_node.stake_weight_estimator->GetWindows() : std::vector<size_t>{};
+    }
     bool hasBlocks(const uint256& block_hash, int min_height, std::optional<int> max_height) override
     {
         // hasBlocks returns true if all ancestors of block_hash in specified
@@ -846,6 +855,10 @@ public:
     {
         StopStake(wallet);
     }
+    void notifyStake() override
+    {
+        node::NotifyStakeMiner();
+    }
     uint64_t getStakeWeight(const wallet::CWallet& wallet) override
     {
         return GetStakeWeight(wallet);
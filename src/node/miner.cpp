@@ -15,6 +15,7 @@
 #include <chainparams.h>
 #include <coins.h>
 #include <common/args.h>
+#include <common/system.h>
 #include <consensus/amount.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
@@ -33,6 +34,7 @@
 #include <util/moneystr.h>
 #include <util/thread.h>
 #include <util/threadnames.h>
+#include <util/trace.h>
 #include <validation.h>
 #include <warnings.h>
 #include <wallet/coincontrol.h>
@@ -138,7 +140,55 @@ void BlockAssembler::resetBlock()
     nFees = 0;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool* pfPoSCancel, int64_t* pFees, CTxDestination destination)
+void BlockAssembler::SetChainContext(const CBlockIndex* pindexPrev)
+{
+    nHeight = pindexPrev->nHeight + 1;
+    m_lock_time_cutoff = pindexPrev->GetMedianTimePast();
+
+    // Decide whether to include witness transactions
+    // This is only needed in case the witness softfork activation is reverted
+    // (which would require a very deep reorganization).
+    // Note that the mempool would accept transactions with witness data before
+    // the deployment is active, but we would only ever mine blocks after activation
+    // unless there is a massive block reorganization with the witness softfork
+    // not activated.
+    // TODO: replace this with a call to main to assess validity of a mempool
+    // transaction (which in most cases can be a no-op).
+    fIncludeWitness = DeploymentActiveAfter(pindexPrev, m_chainstate.m_chainman, Consensus::DEPLOYMENT_SEGWIT);
+}
+
+std::shared_ptr<const BlockTransactions> BlockAssembler::SelectBlockTransactions(uint32_t nTime)
+{
+    resetBlock();
+    pblocktemplate.reset(new CBlockTemplate());
+    auto txs = std::make_shared<BlockTransactions>();
+    txs->nTime = nTime;
+
+    LOCK(::cs_main);
+    const CBlockIndex* pindexPrev = m_chainstate.m_chain.Tip();
+    assert(pindexPrev != nullptr);
+    txs->hashPrevBlock = pindexPrev->GetBlockHash();
+    SetChainContext(pindexPrev);
+
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    if (m_mempool) {
+        LOCK(m_mempool->cs);
+        txs->mempool_sequence = m_mempool->GetSequence();
+        addPackageTxs(*m_mempool, nPackagesSelected, nDescendantsUpdated, nTime);
+    }
+
+    txs->vtx = std::move(pblocktemplate->block.vtx);
+    txs->vTxFees = std::move(pblocktemplate->vTxFees);
+    txs->vTxSigOpsCost = std::move(pblocktemplate->vTxSigOpsCost);
+    txs->nBlockWeight = nBlockWeight;
+    txs->nBlockTx = nBlockTx;
+    txs->nBlockSigOpsCost = nBlockSigOpsCost;
+    txs->nFees = nFees;
+    return txs;
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool* pfPoSCancel, int64_t* pFees, CTxDestination destination, const wallet::StakeKernelHits* pStakeHits, const BlockTransactions* pTransactions)
 {
     const auto time_start{SteadyClock::now()};
 
@@ -159,7 +209,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     LOCK(::cs_main);
     CBlockIndex* pindexPrev = m_chainstate.m_chain.Tip();
     assert(pindexPrev != nullptr);
-    nHeight = pindexPrev->nHeight + 1;
+    SetChainContext(pindexPrev);
 
     pblock->nVersion = m_chainstate.m_chainman.m_versionbitscache.ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
     // -regtest only: allow overriding block.nVersion with
@@ -169,22 +219,22 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
 
     pblock->nTime = GetAdjustedTimeSeconds();
-    m_lock_time_cutoff = pindexPrev->GetMedianTimePast();
-
-    // Decide whether to include witness transactions
-    // This is only needed in case the witness softfork activation is reverted
-    // (which would require a very deep reorganization).
-    // Note that the mempool would accept transactions with witness data before
-    // the deployment is active, but we would only ever mine blocks after activation
-    // unless there is a massive block reorganization with the witness softfork
-    // not activated.
-    // TODO: replace this with a call to main to assess validity of a mempool
-    // transaction (which in most cases can be a no-op).
-    fIncludeWitness = DeploymentActiveAfter(pindexPrev, m_chainstate.m_chainman, Consensus::DEPLOYMENT_SEGWIT);
+    // Only include transactions that are not newer than the coinstake
+    if (pwallet && pStakeHits)
+        pblock->nTime = pStakeHits->nTime;
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    if (m_mempool) {
+    if (pTransactions && pTransactions->hashPrevBlock == pindexPrev->GetBlockHash() && pTransactions->nTime <= pblock->nTime) {
+        // Reuse a selection made earlier for the same tip
+        pblock->vtx.insert(pblock->vtx.end(), pTransactions->vtx.begin(), pTransactions->vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), pTransactions->vTxFees.begin(), pTransactions->vTxFees.end());
+        pblocktemplate->vTxSigOpsCost.insert(pblocktemplate->vTxSigOpsCost.end(), pTransactions->vTxSigOpsCost.begin(), pTransactions->vTxSigOpsCost.end());
+        nBlockWeight = pTransactions->nBlockWeight;
+        nBlockTx = pTransactions->nBlockTx;
+        nBlockSigOpsCost = pTransactions->nBlockSigOpsCost;
+        nFees = pTransactions->nFees;
+    } else if (m_mempool) {
         LOCK(m_mempool->cs);
         addPackageTxs(*m_mempool, nPackagesSelected, nDescendantsUpdated, pblock->nTime);
     }
@@ -210,19 +260,15 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // Proof-of-stake block
 #ifdef ENABLE_WALLET
     // peercoin: if coinstake available add coinstake tx
-    static int64_t nLastCoinStakeSearchTime = GetAdjustedTimeSeconds();  // only initialized at startup
-
     if (pwallet) {
-        // attempt to find a coinstake
+        // turn a kernel found by the staker into a coinstake
         *pfPoSCancel = true;
         pblock->nBits = GetNextTargetRequired(pindexPrev, chainparams.GetConsensus(), true);
         CMutableTransaction txCoinStake;
-        txCoinStake.nTime &= ~chainparams.GetConsensus().nStakeTimestampMask;
-
-        int64_t nSearchTime = txCoinStake.nTime; // search to current time
 
-        if (nSearchTime > nLastCoinStakeSearchTime) {
-            if (wallet::CreateCoinStake(*pwallet, pblock->nBits, 1, txCoinStake, nFees, destination)) {
+        if (pStakeHits && pStakeHits->hashPrevBlock == pindexPrev->GetBlockHash()) {
+            txCoinStake.nTime = pStakeHits->nTime;
+            if (wallet::CreateCoinStake(*pwallet, pblock->nBits, pStakeHits->prevouts, txCoinStake, nFees, destination, pStakeHits->signing)) {
                 if (txCoinStake.nTime >= pindexPrev->GetMedianTimePast()+1) {
                     // Make the coinbase tx empty in case of proof of stake
                     coinbaseTx.vout[0].SetEmpty();
@@ -231,8 +277,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
                     *pfPoSCancel = false;
                 }
             }
-            pwallet->m_last_coin_stake_search_interval = nSearchTime - nLastCoinStakeSearchTime;
-            nLastCoinStakeSearchTime = nSearchTime;
         }
         if (*pfPoSCancel)
             return nullptr; // peercoin: there is no point to continue if we failed to create coinstake
@@ -572,28 +616,6 @@ static bool ProcessBlockFound(const CBlock* pblock, ChainstateManager& chainman)
 }
 
 #ifdef ENABLE_WALLET
-// qtum
-bool SleepStaker(CWallet *pwallet, uint64_t milliseconds) {
-    uint64_t seconds = milliseconds / 1000;
-    milliseconds %= 1000;
-
-    for (unsigned int i = 0; i < seconds; i++) {
-        if(!pwallet->IsStakeClosing())
-            UninterruptibleSleep(std::chrono::seconds{1});
-        else
-            return false;
-    }
-
-    if (milliseconds) {
-        if(!pwallet->IsStakeClosing())
-            UninterruptibleSleep(std::chrono::milliseconds{milliseconds});
-        else
-            return false;
-    }
-
-    return !pwallet->IsStakeClosing();
-}
-
 // qtum
 bool CanStake() {
     bool canStake = gArgs.GetBoolArg("-staking", DEFAULT_STAKE);
@@ -640,170 +662,535 @@ bool SignBlock(CBlock& block, const CWallet& keystore)
     }
 }
 
-// peercoin
-void PoSMiner(CWallet *pwallet)
+static bool SignBlock(CBlock& block, const CWallet& wallet, const wallet::StakeSigningContext& signing) EXCLUSIVE_LOCKS_REQUIRED(wallet.cs_wallet)
 {
-    pwallet->WalletLogPrintf("PoSMiner started for proof-of-stake\n");
-    util::ThreadRename(strprintf("blackcoin-stake-miner-%s", pwallet->GetName()));
+    // The context keeps the keys of a wallet locked since the snapshot
+    if (wallet.IsLocked())
+        return false;
+    std::vector<valtype> vSolutions;
+    if (!block.IsProofOfStake() || Solver(block.vtx[1]->vout[1].scriptPubKey, vSolutions) != TxoutType::PUBKEY)
+        return false;
 
-    unsigned int nExtraNonce = 0;
+    const std::pair<CKey, CPubKey>* key = signing.FindKey(CPubKey(vSolutions[0]).GetID());
+    return key && key->first.Sign(block.GetHash(), block.vchBlockSig, 0);
+}
 
+// Staking address of the wallet, created on first use
+static CTxDestination GetStakeDestination(CWallet& wallet)
+{
     CTxDestination dest;
+    LOCK2(wallet.cs_wallet, cs_main);
+    const std::string label = "Staking Legacy Address";
+    wallet.ForEachAddrBookEntry([&](const CTxDestination& _dest, const std::string& _label, bool _is_change, const std::optional<wallet::AddressPurpose>& _purpose) {
+        if (_is_change) return;
+        if (_label == label)
+            dest = _dest;
+    });
+
+    if (std::get_if<CNoDestination>(&dest)) {
+        // create mintkey address
+        auto op_dest = wallet.GetNewDestination(OutputType::LEGACY, label);
+        if (!op_dest)
+            throw std::runtime_error("Error: Keypool ran out, please call keypoolrefill first.");
+        dest = *op_dest;
+    }
+    return dest;
+}
 
-    // Compute timeout for pos as sqrt(numUTXO)
-    unsigned int pos_timio;
+// Time until the masked timestamp slot after nSearchTime begins.
+// Kernels can only differ between slots, so there is nothing to search for before that.
+static std::chrono::milliseconds TimeUntilNextSlot(int64_t nSearchTime)
+{
+    const NodeClock::time_point next_slot{std::chrono::seconds{(nSearchTime | Params().GetConsensus().nStakeTimestampMask) + 1}};
+    return std::max(std::chrono::duration_cast<std::chrono::milliseconds>(next_slot - GetAdjustedTime()), std::chrono::milliseconds{0});
+}
+
+StakeMiner::~StakeMiner()
+{
+    LOCK(m_control_mutex);
+    if (m_thread.joinable()) {
+        WITH_LOCK(m_mutex, m_stop = true);
+        m_interrupt_search = true;
+        m_cv.notify_all();
+        m_thread.join();
+    }
+}
+
+void StakeMiner::AddWallet(CWallet* pwallet)
+{
+    LOCK(m_control_mutex);
     {
-        LOCK2(pwallet->cs_wallet, cs_main);
-        const std::string label = "Staking Legacy Address";
-        pwallet->ForEachAddrBookEntry([&](const CTxDestination& _dest, const std::string& _label, bool _is_change, const std::optional<wallet::AddressPurpose>& _purpose) {
-            if (_is_change) return;
-            if (_label == label)
-                dest = _dest;
-        });
-
-        if (std::get_if<CNoDestination>(&dest)) {
-            // create mintkey address
-            auto op_dest = pwallet->GetNewDestination(OutputType::LEGACY, label);
-            if (!op_dest)
-                throw std::runtime_error("Error: Keypool ran out, please call keypoolrefill first.");
-            dest = *op_dest;
-        }
-
-        std::vector<std::pair<const CWalletTx*, unsigned int> > vCoins;
-        CCoinControl coincontrol;
-        AvailableCoinsForStaking(*pwallet, vCoins, &coincontrol);
-        pos_timio = gArgs.GetIntArg("-staketimio", DEFAULT_STAKETIMIO) + 30 * sqrt(vCoins.size());
-        pwallet->WalletLogPrintf("Set proof-of-stake timeout: %ums for %u UTXOs\n", pos_timio, vCoins.size());
-    }
-
-    try {
-        while (true)
-        {
-            while (pwallet->IsLocked() || !pwallet->m_enabled_staking || fReindex || pwallet->chain().chainman().m_blockman.m_importing) {
-                pwallet->m_last_coin_stake_search_interval = 0;
-                if (!SleepStaker(pwallet, 5000))
-                    return;
-            }
+        LOCK(m_mutex);
+        for (const WalletState& state : m_wallets) {
+            if (state.pwallet == pwallet) return;
+        }
+        m_wallets.push_back({pwallet, CNoDestination(), {}, {}});
+        m_notified = true;
+    }
+    m_cv.notify_all();
+    if (!m_thread.joinable()) {
+        m_last_search_time = GetAdjustedTimeSeconds();
+        m_prepare_template = gArgs.GetBoolArg("-stakepreparetemplate", DEFAULT_STAKE_PREPARE_TEMPLATE);
+        int threads = gArgs.GetIntArg("-stakethreads", DEFAULT_STAKE_THREADS);
+        if (threads <= 0) {
+            // -stakethreads=0 means one thread per core, -stakethreads=-n leaves n cores free
+            threads += GetNumCores();
+        }
+        m_search_pool = std::make_unique<StakeSearchPool>(threads);
+        m_thread = std::thread(&StakeMiner::ThreadStakeMiner, this);
+    }
+}
 
-            // Busy-wait for the network to come online so we don't waste time mining
-            // on an obsolete chain. In regtest mode we expect to fly solo.
-            if (!Params().MineBlocksOnDemand()) {
-                while (pwallet->chain().getNodeCount(ConnectionDirection::Both) == 0 || pwallet->chain().isInitialBlockDownload()) {
-                    pwallet->m_last_coin_stake_search_interval = 0;
-                    if (!SleepStaker(pwallet, 10000))
-                        return;
-                }
-            }
+void StakeMiner::RemoveWallet(CWallet* pwallet)
+{
+    LOCK(m_control_mutex);
+    bool stop{false};
+    {
+        WAIT_LOCK(m_mutex, lock);
+        auto it = std::find_if(m_wallets.begin(), m_wallets.end(), [&](const WalletState& state) { return state.pwallet == pwallet; });
+        if (it == m_wallets.end()) return;
+        m_interrupt_search = true;
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_in_round; });
+        m_wallets.erase(it);
+        stop = m_stop = m_wallets.empty();
+    }
+    m_cv.notify_all();
+    if (stop && m_thread.joinable()) {
+        m_thread.join();
+        WITH_LOCK(m_mutex, m_stop = false);
+        m_block_txs.reset();
+        const std::vector<StakeSearchStats> stats{m_search_pool->GetStats()};
+        for (size_t i = 0; i < stats.size(); ++i) {
+            LogPrint(BCLog::COINSTAKE, "StakeMiner: search thread %u evaluated %u kernels in %u chunks (%u stolen), busy for %.2fs\n",
+                     i, stats[i].kernels, stats[i].chunks, stats[i].stolen, Ticks<SecondsDouble>(stats[i].busy));
+        }
+        m_search_pool.reset();
+    }
+}
 
-            while (GuessVerificationProgress(Params().TxData(), pwallet->chain().getTip()) < 0.996) {
-                pwallet->m_last_coin_stake_search_interval = 0;
-                pwallet->WalletLogPrintf("Staker thread sleeps while sync at %f\n", GuessVerificationProgress(Params().TxData(), pwallet->chain().getTip()));
-                if (!SleepStaker(pwallet, 10000))
-                    return;
-            }
+void StakeMiner::Notify()
+{
+    WITH_LOCK(m_mutex, m_notified = true);
+    m_interrupt_search = true;
+    m_cv.notify_all();
+}
 
-            //
-            // Create new block
-            //
-            CBlockIndex* pindexPrev = pwallet->chain().getTip();
-            bool fPoSCancel{false};
-            int64_t pFees{0};
-            CBlock *pblock;
-            std::unique_ptr<CBlockTemplate> pblocktemplate;
-
-            {
-                LOCK2(pwallet->cs_wallet, cs_main);
-                try {
-                    pblocktemplate = BlockAssembler{pwallet->chain().chainman().ActiveChainstate(), &pwallet->chain().mempool()}.CreateNewBlock(GetScriptForDestination(dest), pwallet, &fPoSCancel, &pFees, dest);
-                }
-                catch (const std::runtime_error &e)
-                {
-                    pwallet->WalletLogPrintf("PoSMiner runtime error: %s\n", e.what());
-                    continue;
-                }
+StakeMinerStats StakeMiner::GetStats()
+{
+    StakeMinerStats stats{WITH_LOCK(m_stats_mutex, return m_stats)};
+    LOCK(m_control_mutex);
+    if (m_search_pool) stats.search_threads = m_search_pool->GetStats();
+    return stats;
+}
+
+void StakeMiner::RecordStage(StakeStage stage, SteadyClock::time_point time_start)
+{
+    const auto latency{std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - time_start)};
+    LOCK(m_stats_mutex);
+    m_stats.stages[static_cast<size_t>(stage)].Add(latency);
+}
+
+bool StakeMiner::Wait(std::chrono::milliseconds timeout, bool wake_on_notify)
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_cv.wait_for(lock, timeout, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        return m_stop || (wake_on_notify && m_notified);
+    });
+    return !m_stop;
+}
+
+// peercoin
+void StakeMiner::ThreadStakeMiner()
+{
+    LogPrintf("StakeMiner started for proof-of-stake\n");
+    util::ThreadRename("blackcoin-stake-miner");
+
+    std::vector<WalletState*> wallets;
+    while (true) {
+        {
+            LOCK(m_mutex);
+            if (m_stop) break;
+            m_notified = false;
+            m_interrupt_search = false;
+            m_in_round = true;
+            wallets.clear();
+            for (WalletState& state : m_wallets) {
+                wallets.push_back(&state);
             }
+        }
 
-            if (!pblocktemplate.get())
-            {
-                if (fPoSCancel == true)
-                {
-                    if (!SleepStaker(pwallet, pos_timio))
-                        return;
-                    continue;
-                }
-                pwallet->WalletLogPrintf("Error in PoSMiner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
-                if (!SleepStaker(pwallet, 10000))
-                   return;
+        bool wake_on_notify{false};
+        std::chrono::milliseconds timeout{0};
+        try {
+            timeout = StakeRound(wallets, wake_on_notify);
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "ThreadStakeMiner()");
+            timeout = std::chrono::milliseconds{10000};
+        } catch (...) {
+            PrintExceptionContinue(nullptr, "ThreadStakeMiner()");
+            timeout = std::chrono::milliseconds{10000};
+        }
+
+        WITH_LOCK(m_mutex, m_in_round = false);
+        m_cv.notify_all();
+        if (!Wait(timeout, wake_on_notify))
+            break;
+    }
+
+    LogPrintf("StakeMiner stopped\n");
+}
 
-                return;
+std::chrono::milliseconds StakeMiner::StakeRound(const std::vector<WalletState*>& wallets, bool& wake_on_notify)
+{
+    std::vector<WalletState*> active;
+    for (WalletState* state : wallets) {
+        CWallet* pwallet = state->pwallet;
+        if (pwallet->IsStakeClosing())
+            continue;
+        if (pwallet->IsLocked() || !pwallet->m_enabled_staking || fReindex || pwallet->chain().chainman().m_blockman.m_importing) {
+            pwallet->m_last_coin_stake_search_interval = 0;
+            // Do not keep private keys around while not staking
+            state->snapshot.signing = {};
+            continue;
+        }
+        if (std::get_if<CNoDestination>(&state->dest)) {
+            try {
+                state->dest = GetStakeDestination(*pwallet);
+            } catch (const std::runtime_error& e) {
+                pwallet->WalletLogPrintf("PoSMiner: %s\n", e.what());
+                pwallet->m_enabled_staking = false;
+                continue;
             }
-            pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
-
-            // peercoin: if proof-of-stake block found then process block
-            if (pblock->IsProofOfStake())
-            {
-                {
-                    LOCK2(pwallet->cs_wallet, cs_main);
-                    if (!SignBlock(*pblock, *pwallet))
-                    {
-                        pwallet->WalletLogPrintf("PoSMiner: failed to sign PoS block\n");
-                        continue;
-                    }
-                }
-                pwallet->WalletLogPrintf("PoSMiner: proof-of-stake block found %s\n", pblock->GetHash().ToString());
-                ProcessBlockFound(pblock, pwallet->chain().chainman());
+        }
+        active.push_back(state);
+    }
+    // Slots are only missed while searching every slot
+    m_searching = m_searching && !active.empty();
+    if (active.empty())
+        return std::chrono::milliseconds{5000};
+
+    // All the wallets are attached to the same node
+    interfaces::Chain& chain = active.front()->pwallet->chain();
+    const auto pause = [&](std::chrono::milliseconds timeout) {
+        for (WalletState* state : active) {
+            state->pwallet->m_last_coin_stake_search_interval = 0;
+        }
+        m_searching = false;
+        return timeout;
+    };
+    UpdateStakedBlocks(chain.chainman());
+
+    // Busy-wait for the network to come online so we don't waste time mining
+    // on an obsolete chain. In regtest mode we expect to fly solo.
+    if (!Params().MineBlocksOnDemand() && (chain.getNodeCount(ConnectionDirection::Both) == 0 || chain.isInitialBlockDownload()))
+        return pause(std::chrono::milliseconds{10000});
+
+    const double progress = GuessVerificationProgress(Params().TxData(), chain.getTip());
+    if (progress < 0.996) {
+        LogPrintf("Staker thread sleeps while sync at %f\n", progress);
+        return pause(std::chrono::milliseconds{10000});
+    }
+
+    //
+    // Search for a kernel once per timestamp slot and once per tip,
+    // cs_main and cs_wallet are only held to take the snapshots
+    //
+    wake_on_notify = true;
+    const int64_t nSearchTime = GetAdjustedTimeSeconds() & ~Params().GetConsensus().nStakeTimestampMask;
+    const uint256 hashTip = chain.getTip()->GetBlockHash();
+    if (nSearchTime <= m_last_search_time && hashTip == m_last_search_tip)
+        return TimeUntilNextSlot(nSearchTime);
+    const auto time_start{SteadyClock::now()};
+    uint64_t slots_missed{0};
+    if (nSearchTime > m_last_search_time) {
+        for (WalletState* state : active) {
+            state->pwallet->m_last_coin_stake_search_interval = nSearchTime - m_last_search_time;
+        }
+        if (m_searching)
+            slots_missed = (nSearchTime - m_last_search_time) / (Params().GetConsensus().nStakeTimestampMask + 1) - 1;
+        m_last_search_time = nSearchTime;
+        LOCK(m_stats_mutex);
+        ++m_stats.slots_searched;
+        m_stats.slots_missed += slots_missed;
+    }
+    m_last_search_tip = hashTip;
+    m_searching = true;
+
+    // The kernels of the upcoming slots are evaluated once per tip, so a slot
+    // with a kernel is known in advance and its block built without hashing
+    std::vector<WalletState*> search;
+    for (WalletState* state : active) {
+        wallet::StakeSchedule& schedule = state->schedule;
+        if (schedule.hashPrevBlock != hashTip || nSearchTime < schedule.nTimeFrom || nSearchTime > schedule.nTimeTo) {
+            const auto time_snapshot{SteadyClock::now()};
+            schedule = {};
+            if (wallet::CreateStakeSnapshot(*state->pwallet, state->snapshot, state->dest))
+                search.push_back(state);
+            RecordStage(StakeStage::SNAPSHOT, time_snapshot);
+        }
+    }
+    const auto end_round = [&](uint64_t kernels_found) {
+        const auto latency{std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - time_start)};
+        TRACE5(staking, round,
+            nSearchTime,
+            active.size(),
+            kernels_found,
+            slots_missed,
+            count_microseconds(latency));
+        LOCK(m_stats_mutex);
+        m_stats.round.Add(latency);
+        ++m_stats.rounds;
+        m_stats.kernels_found += kernels_found;
+    };
+
+    // A search stops at the first kernel of the current slot. The wallets it did
+    // not get through are searched again if no block could be staked with it.
+    wallet::StakeKernelHits hits;
+    std::vector<const WalletState*> tried;
+    uint64_t kernels_found{0};
+    do {
+        if (!search.empty() && !SearchKernels(search, nSearchTime)) {
+            // Cancelled by a new tip or a wallet being removed
+            m_last_search_tip.SetNull();
+            end_round(kernels_found);
+            return std::chrono::milliseconds{0};
+        }
+        for (WalletState* state : active) {
+            if (std::count(tried.begin(), tried.end(), state) || std::count(search.begin(), search.end(), state))
+                continue;
+            tried.push_back(state);
+            if (!wallet::GetScheduledKernels(state->schedule, nSearchTime, hits))
+                continue;
+            kernels_found += hits.prevouts.size();
+            hits.signing = &state->snapshot.signing;
+            if (StakeBlock(*state, hits)) {
+                end_round(kernels_found);
                 // Rest for ~16 seconds after successful block to preserve close quick
-                uint64_t stakerRestTime = (16 + GetRand(4)) * 1000;
-                if (!SleepStaker(pwallet, stakerRestTime))
-                    return;
+                m_searching = false;
+                wake_on_notify = false;
+                return std::chrono::milliseconds{(16 + GetRand(4)) * 1000};
             }
-            if (!SleepStaker(pwallet, pos_timio))
-                return;
+        }
+    } while (!search.empty());
+    end_round(kernels_found);
+
+    // Without a kernel no transactions are selected, unless the block of the next
+    // kernel should be ready without waiting for cs_main and the mempool
+    if (m_prepare_template)
+        UpdateBlockTransactions(chain.chainman(), chain.mempool(), hashTip, nSearchTime);
 
+    return TimeUntilNextSlot(nSearchTime);
+}
+
+bool StakeMiner::SearchKernels(std::vector<WalletState*>& wallets, uint32_t nSearchTime)
+{
+    const auto time_start{SteadyClock::now()};
+    const uint32_t nSlotSpacing = Params().GetConsensus().nStakeTimestampMask + 1;
+    std::vector<StakeSearchJob> jobs;
+    size_t kernels{0};
+    for (const WalletState* state : wallets) {
+        jobs.push_back({&state->snapshot.kernels, nSearchTime, wallet::STAKE_AHEAD_SLOTS, {}});
+        kernels += state->snapshot.kernels.size();
+    }
+    const auto count_kernels = [&] {
+        uint64_t count{0};
+        for (const StakeSearchStats& stats : m_search_pool->GetStats()) {
+            count += stats.kernels;
+        }
+        return count;
+    };
+    const uint64_t kernels_before{count_kernels()};
+    const bool complete = m_search_pool->Search(jobs, nSlotSpacing, /*stop_on_first_hit=*/true, m_interrupt_search);
+    const uint64_t kernels_evaluated{count_kernels() - kernels_before};
+    const auto latency{std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - time_start)};
+    TRACE5(staking, kernel_search,
+        wallets.size(),
+        kernels_evaluated,
+        m_search_pool->Threads(),
+        complete,
+        count_microseconds(latency));
+    {
+        LOCK(m_stats_mutex);
+        m_stats.stages[static_cast<size_t>(StakeStage::KERNEL_SEARCH)].Add(latency);
+        m_stats.kernels_evaluated += kernels_evaluated;
+        m_stats.kernel_search_time += latency;
+    }
+    if (!complete && m_interrupt_search)
+        return false;
+
+    std::vector<WalletState*> pending;
+    for (size_t i = 0; i < wallets.size(); ++i) {
+        WalletState& state = *wallets[i];
+        const StakeSearchJob& job = jobs[i];
+        if (!complete && !job.hits.count(nSearchTime)) {
+            pending.push_back(&state);
             continue;
         }
+        // After a search stopped on a kernel only the current slot is known
+        wallet::StakeSchedule& schedule = state.schedule;
+        schedule.hashPrevBlock = state.snapshot.hashPrevBlock;
+        schedule.nTimeFrom = nSearchTime;
+        schedule.nTimeTo = complete ? nSearchTime + (wallet::STAKE_AHEAD_SLOTS - 1) * nSlotSpacing : nSearchTime;
+        schedule.hits.clear();
+        for (const auto& [nTime, indexes] : job.hits) {
+            std::vector<COutPoint>& prevouts = schedule.hits[nTime];
+            for (const size_t index : indexes)
+                prevouts.push_back(state.snapshot.prevouts[index]);
+        }
     }
-    catch (const std::runtime_error &e)
-    {
-        pwallet->WalletLogPrintf("PoSMiner: runtime error: %s\n", e.what());
+    LogPrint(BCLog::COINSTAKE, "StakeMiner: searched %u kernels of %u wallets %s on %u threads in %.2fms\n",
+             kernels, wallets.size(), complete ? "over all slots" : "until the first kernel", m_search_pool->Threads(),
+             Ticks<MillisecondsDouble>(latency));
+    wallets.swap(pending);
+    return true;
+}
+
+void StakeMiner::UpdateBlockTransactions(ChainstateManager& chainman, const CTxMemPool& mempool, const uint256& hashPrevBlock, uint32_t nTime)
+{
+    if (m_block_txs && m_block_txs->hashPrevBlock == hashPrevBlock && m_block_txs->nTime <= nTime &&
+        m_block_txs->mempool_sequence == WITH_LOCK(mempool.cs, return mempool.GetSequence())) {
         return;
     }
+    const auto time_start{SteadyClock::now()};
+    m_block_txs = BlockAssembler{chainman.ActiveChainstate(), &mempool}.SelectBlockTransactions(nTime);
+    LogPrint(BCLog::COINSTAKE, "StakeMiner: selected %u mempool transactions for the next block in %.2fms\n",
+             m_block_txs->vtx.size(), Ticks<MillisecondsDouble>(SteadyClock::now() - time_start));
 }
 
-// peercoin: stake miner thread
-void static ThreadStakeMiner(CWallet *pwallet)
+bool StakeMiner::StakeBlock(WalletState& state, const wallet::StakeKernelHits& hits)
 {
-    pwallet->WalletLogPrintf("ThreadStakeMiner started\n");
-    while (true) {
+    CWallet* pwallet = state.pwallet;
+    ChainstateManager& chainman = pwallet->chain().chainman();
+    const CTxMemPool& mempool = pwallet->chain().mempool();
+
+    // The mempool transactions are only selected once a kernel is found, and
+    // then kept for all the wallets until the tip or the mempool changes
+    const auto time_template{SteadyClock::now()};
+    UpdateBlockTransactions(chainman, mempool, hits.hashPrevBlock, hits.nTime);
+
+    //
+    // Create new block
+    //
+    CBlockIndex* pindexPrev = pwallet->chain().getTip();
+    bool fPoSCancel{false};
+    int64_t pFees{0};
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    {
+        LOCK2(pwallet->cs_wallet, cs_main);
         try {
-            PoSMiner(pwallet);
-            break;
+            pblocktemplate = BlockAssembler{chainman.ActiveChainstate(), &mempool}.CreateNewBlock(GetScriptForDestination(state.dest), pwallet, &fPoSCancel, &pFees, state.dest, &hits, m_block_txs.get());
         }
-        catch (std::exception& e) {
-            PrintExceptionContinue(&e, "ThreadStakeMiner()");
-        } catch (...) {
-            PrintExceptionContinue(nullptr, "ThreadStakeMiner()");
+        catch (const std::runtime_error &e)
+        {
+            pwallet->WalletLogPrintf("PoSMiner runtime error: %s\n", e.what());
+            return false;
         }
     }
-    pwallet->WalletLogPrintf("ThreadStakeMiner stopped\n");
+
+    if (!pblocktemplate.get()) {
+        if (!fPoSCancel) {
+            pwallet->WalletLogPrintf("Error in PoSMiner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
+            pwallet->m_enabled_staking = false;
+        }
+        return false;
+    }
+    CBlock* pblock = &pblocktemplate->block;
+    IncrementExtraNonce(pblock, pindexPrev, m_extra_nonce);
+    RecordStage(StakeStage::TEMPLATE, time_template);
+
+    // peercoin: if proof-of-stake block found then process block
+    if (!pblock->IsProofOfStake())
+        return false;
+    const auto time_sign{SteadyClock::now()};
+    int nHeight;
+    {
+        LOCK2(pwallet->cs_wallet, cs_main);
+        // The key of the coinstake output was looked up with the stake snapshot
+        const bool fSigned{hits.signing && SignBlock(*pblock, *pwallet, *hits.signing)};
+        if (!fSigned && !SignBlock(*pblock, *pwallet)) {
+            pwallet->WalletLogPrintf("PoSMiner: failed to sign PoS block\n");
+            return false;
+        }
+        if (pblock->hashPrevBlock != chainman.ActiveChain().Tip()->GetBlockHash()) {
+            WITH_LOCK(m_stats_mutex, ++m_stats.stale_templates);
+            pwallet->WalletLogPrintf("PoSMiner: the tip changed while staking on %s\n", pblock->hashPrevBlock.ToString());
+            return false;
+        }
+        nHeight = chainman.ActiveChain().Height() + 1;
+    }
+    RecordStage(StakeStage::SIGN, time_sign);
+    const uint256 hash{pblock->GetHash()};
+    pwallet->WalletLogPrintf("PoSMiner: proof-of-stake block found %s\n", hash.ToString());
+    const auto time_process{SteadyClock::now()};
+    const bool accepted{ProcessBlockFound(pblock, chainman)};
+    RecordStage(StakeStage::PROCESS_BLOCK, time_process);
+    TRACE3(staking, block_staked,
+        hash.data(),
+        nHeight,
+        accepted);
+    if (accepted) {
+        m_staked_blocks.emplace_back(nHeight, hash);
+    }
+    {
+        LOCK(m_stats_mutex);
+        ++(accepted ? m_stats.blocks_staked : m_stats.blocks_rejected);
+    }
+    return true;
 }
 
-// qtum
-void StakeCoins(bool fStake, CWallet *pwallet, std::unique_ptr<std::vector<std::thread>>& threadStakeMinerGroup)
+void StakeMiner::UpdateStakedBlocks(ChainstateManager& chainman)
 {
-    // If threadStakeMinerGroup is initialized join all threads and clear the vector
-    if (threadStakeMinerGroup) {
-        for (std::thread& thread : *threadStakeMinerGroup)
-            if (thread.joinable()) thread.join();
-        threadStakeMinerGroup->clear();
+    if (m_staked_blocks.empty())
+        return;
+    uint64_t orphaned{0}, confirmed{0};
+    {
+        LOCK(cs_main);
+        const CChain& active_chain = chainman.ActiveChain();
+        for (auto it = m_staked_blocks.begin(); it != m_staked_blocks.end();) {
+            const auto& [nHeight, hash] = *it;
+            const CBlockIndex* pindex = active_chain[nHeight];
+            if (!pindex || (pindex->GetBlockHash() == hash && active_chain.Height() - nHeight < STAKE_CONFIRM_DEPTH)) {
+                ++it;
+                continue;
+            }
+            if (pindex->GetBlockHash() == hash) {
+                ++confirmed;
+            } else {
+                LogPrint(BCLog::COINSTAKE, "StakeMiner: staked block %s at height %d was orphaned\n", hash.ToString(), nHeight);
+                TRACE2(staking, block_orphaned,
+                    hash.data(),
+                    nHeight);
+                ++orphaned;
+            }
+            it = m_staked_blocks.erase(it);
+        }
     }
+    LOCK(m_stats_mutex);
+    m_stats.blocks_orphaned += orphaned;
+    m_stats.blocks_confirmed += confirmed;
+}
 
+static StakeMiner g_stake_miner;
+
+// qtum
+void StakeCoins(bool fStake, CWallet *pwallet)
+{
     if (fStake) {
-        threadStakeMinerGroup = std::make_unique<std::vector<std::thread>>();
-        threadStakeMinerGroup->emplace_back(std::thread(&ThreadStakeMiner, pwallet));
+        g_stake_miner.AddWallet(pwallet);
+    } else {
+        g_stake_miner.RemoveWallet(pwallet);
     }
 }
+
+void NotifyStakeMiner()
+{
+    g_stake_miner.Notify();
+}
+
+StakeMinerStats GetStakeMinerStats()
+{
+    return g_stake_miner.GetStats();
+}
 #endif
 
 } // namespace node
@@ -15,15 +15,24 @@
 #include <policy/policy.h>
 #include <primitives/block.h>
 #include <txmempool.h>
+#include <util/time.h>
 #include <node/context.h>
 #include <wallet/wallet.h>
 #ifdef ENABLE_WALLET
+#include <node/stake_search.h>
+#include <node/stake_stats.h>
 #include <wallet/staking.h>
 #endif
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
 #include <memory>
 #include <optional>
 #include <stdint.h>
+#include <thread>
+#include <utility>
 
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/indexed_by.hpp>
@@ -39,6 +48,7 @@ class Chainstate;
 class ChainstateManager;
 
 namespace Consensus { struct Params; };
+namespace wallet { struct StakeKernelHits; };
 
 namespace node {
 static const bool DEFAULT_PRINTPRIORITY = false;
@@ -47,8 +57,8 @@ static const bool DEFAULT_PRINTPRIORITY = false;
 static const bool DEFAULT_STAKE = true;
 //! -stakecache default
 static const bool DEFAULT_STAKE_CACHE = false;
-//! -staketimio default, proof-of-stake timeout in ms
-static const unsigned int DEFAULT_STAKETIMIO = 500;
+//! -stakepreparetemplate default
+static const bool DEFAULT_STAKE_PREPARE_TEMPLATE = false;
 
 struct CBlockTemplate
 {
@@ -58,6 +68,24 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
+/** Mempool transactions selected for a block on top of hashPrevBlock, without the
+ *  coinbase and coinstake, valid until the tip or the mempool changes */
+struct BlockTransactions
+{
+    uint256 hashPrevBlock;
+    //! CTxMemPool::GetSequence() at selection time
+    uint64_t mempool_sequence{0};
+    //! Transactions are not newer than this
+    uint32_t nTime{0};
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOpsCost;
+    uint64_t nBlockWeight{0};
+    uint64_t nBlockTx{0};
+    uint64_t nBlockSigOpsCost{0};
+    CAmount nFees{0};
+};
+
 // Container for tracking updates to ancestor feerate as we include (parent)
 // transactions in a block
 struct CTxMemPoolModifiedEntry {
@@ -187,8 +215,13 @@ public:
     explicit BlockAssembler(Chainstate& chainstate, const CTxMemPool* mempool);
     explicit BlockAssembler(Chainstate& chainstate, const CTxMemPool* mempool, const Options& options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet = nullptr, bool* pfPoSCancel = nullptr, int64_t* pFees = 0, CTxDestination destination = CNoDestination());
+    /** Construct a new block template with coinbase to scriptPubKeyIn,
+     *  or a proof-of-stake block with a coinstake for one of the kernels in pStakeHits.
+     *  The mempool transactions of pTransactions are used if they still apply. */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet = nullptr, bool* pfPoSCancel = nullptr, int64_t* pFees = 0, CTxDestination destination = CNoDestination(), const wallet::StakeKernelHits* pStakeHits = nullptr, const BlockTransactions* pTransactions = nullptr);
+
+    /** Select the mempool transactions of a block on top of the tip, not newer than nTime */
+    std::shared_ptr<const BlockTransactions> SelectBlockTransactions(uint32_t nTime);
 
     inline static std::optional<int64_t> m_last_block_num_txs{};
     inline static std::optional<int64_t> m_last_block_weight{};
@@ -199,6 +232,8 @@ private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Set the chain context of a block on top of pindexPrev */
+    void SetChainContext(const CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
@@ -231,8 +266,90 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 /** Check if staking is enabled */
 bool CanStake();
 
-/** Mine proof-of-stake blocks */
-void StakeCoins(bool fStake, wallet::CWallet *pwallet, std::unique_ptr<std::vector<std::thread>>& threadStakeMinerGroup);
+/**
+ * Stakes for every wallet with staking enabled from a single thread. The kernels of
+ * all the wallets are searched once per timestamp slot and tip, and the mempool
+ * transactions of the block are selected once per tip and mempool change for
+ * whichever wallet finds a kernel, instead of once per wallet and attempt.
+ */
+class StakeMiner
+{
+public:
+    ~StakeMiner();
+
+    /** Start staking with the wallet, starting the staking thread if needed */
+    void AddWallet(wallet::CWallet* pwallet) EXCLUSIVE_LOCKS_REQUIRED(!m_control_mutex, !m_mutex);
+    /** Stop staking with the wallet and wait until the staking thread no longer uses it.
+     *  The staking thread is stopped with the last wallet. */
+    void RemoveWallet(wallet::CWallet* pwallet) EXCLUSIVE_LOCKS_REQUIRED(!m_control_mutex, !m_mutex);
+    /** Wake the staking thread, e.g. on a new tip, cancelling a running kernel search */
+    void Notify() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    StakeMinerStats GetStats() EXCLUSIVE_LOCKS_REQUIRED(!m_control_mutex, !m_stats_mutex);
+
+private:
+    struct WalletState {
+        wallet::CWallet* pwallet;
+        CTxDestination dest;
+        wallet::StakeSnapshot snapshot;
+        wallet::StakeSchedule schedule;
+    };
+
+    void ThreadStakeMiner() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    /** Search all the wallets for a kernel in the current slot and stake a block if
+     *  one is found. Returns how long to wait for, wake_on_notify is set if the wait
+     *  should end on a new tip. */
+    std::chrono::milliseconds StakeRound(const std::vector<WalletState*>& wallets, bool& wake_on_notify);
+    bool StakeBlock(WalletState& state, const wallet::StakeKernelHits& hits);
+    /** Select the mempool transactions of the next block again if the tip or the mempool changed */
+    void UpdateBlockTransactions(ChainstateManager& chainman, const CTxMemPool& mempool, const uint256& hashPrevBlock, uint32_t nTime);
+    /** Schedule the kernels of the wallets on the search threads. The wallets the search
+     *  stopped before are left in wallets. Returns false if the search was cancelled. */
+    bool SearchKernels(std::vector<WalletState*>& wallets, uint32_t nSearchTime);
+    /** Count the staked blocks that left the active chain, or got deep enough in it */
+    void UpdateStakedBlocks(ChainstateManager& chainman) EXCLUSIVE_LOCKS_REQUIRED(!m_stats_mutex);
+    void RecordStage(StakeStage stage, SteadyClock::time_point time_start) EXCLUSIVE_LOCKS_REQUIRED(!m_stats_mutex);
+    bool Wait(std::chrono::milliseconds timeout, bool wake_on_notify) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    //! Serializes starting and stopping the staking thread
+    Mutex m_control_mutex;
+    std::thread m_thread GUARDED_BY(m_control_mutex);
+    //! Kernel search threads (-stakethreads), live as long as the staking thread
+    std::unique_ptr<StakeSearchPool> m_search_pool;
+    //! Cancels the running kernel search, cleared at the start of every round
+    std::atomic<bool> m_interrupt_search{false};
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::list<WalletState> m_wallets GUARDED_BY(m_mutex);
+    //! Whether the staking thread is using m_wallets outside of m_mutex
+    bool m_in_round GUARDED_BY(m_mutex){false};
+    bool m_notified GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    Mutex m_stats_mutex;
+    StakeMinerStats m_stats GUARDED_BY(m_stats_mutex);
+
+    // Only used by the staking thread
+    //! Keep m_block_txs up to date between kernels (-stakepreparetemplate)
+    bool m_prepare_template{DEFAULT_STAKE_PREPARE_TEMPLATE};
+    unsigned int m_extra_nonce{0};
+    int64_t m_last_search_time{0};
+    uint256 m_last_search_tip;
+    //! Whether the last round searched its slot, so that skipped slots count as missed
+    bool m_searching{false};
+    //! Accepted staked blocks not yet STAKE_CONFIRM_DEPTH deep, by height
+    std::vector<std::pair<int, uint256>> m_staked_blocks;
+    std::shared_ptr<const BlockTransactions> m_block_txs;
+};
+
+/** Start or stop staking with the wallet */
+void StakeCoins(bool fStake, wallet::CWallet *pwallet);
+
+/** Wake the staking thread on a new tip */
+void NotifyStakeMiner();
+
+/** Latencies and counters of the staking thread */
+StakeMinerStats GetStakeMinerStats();
 #endif
 
 /** Update an old GenerateCoinbaseCommitment from CreateNewBlock after the block txs have changed */
@@ -0,0 +1,186 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/stake_search.h>
+
+#include <pos.h>
+#include <span.h>
+#include <tinyformat.h>
+#include <util/threadnames.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace node {
+StakeSearchPool::StakeSearchPool(int threads)
+{
+    threads = std::clamp(threads, 1, MAX_STAKE_THREADS);
+    for (int i = 0; i < threads; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 1; i < threads; ++i) {
+        m_threads.emplace_back([this, i] { ThreadSearch(i); });
+    }
+}
+
+StakeSearchPool::~StakeSearchPool()
+{
+    WITH_LOCK(m_mutex, m_stop = true);
+    m_work_cv.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void StakeSearchPool::ThreadSearch(size_t id)
+{
+    util::ThreadRename(strprintf("stakesearch.%i", id));
+    uint64_t generation{0};
+    while (true) {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_work_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || m_generation != generation; });
+            if (m_stop) return;
+            generation = m_generation;
+        }
+        Work(id);
+        {
+            LOCK(m_mutex);
+            if (--m_busy == 0) m_done_cv.notify_all();
+        }
+    }
+}
+
+bool StakeSearchPool::Take(size_t id, Chunk& chunk, bool& stolen)
+{
+    {
+        Queue& own = *m_queues[id];
+        LOCK(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+            stolen = false;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        Queue& victim = *m_queues[(id + i) % m_queues.size()];
+        LOCK(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void StakeSearchPool::Work(size_t id)
+{
+    Chunk chunk;
+    bool stolen;
+    std::vector<size_t> batch_hits;
+    std::vector<std::pair<uint32_t, size_t>> found;
+    while (!m_stopped && Take(id, chunk, stolen)) {
+        if (*m_interrupt) {
+            m_stopped = true;
+            break;
+        }
+        const auto time_start{SteadyClock::now()};
+        StakeSearchJob& job = (*m_jobs)[chunk.job];
+        const Span<const CStakeKernel> kernels{Span{*job.kernels}.subspan(chunk.begin, chunk.end - chunk.begin)};
+
+        found.clear();
+        for (unsigned int slot = 0; slot < job.nSlots; ++slot) {
+            const uint32_t nTime = job.nTimeFrom + slot * m_slot_spacing;
+            batch_hits.clear();
+            CheckStakeKernelHashBatch(kernels, nTime, batch_hits);
+            for (const size_t i : batch_hits) {
+                found.emplace_back(nTime, chunk.begin + i);
+            }
+        }
+        if (!found.empty()) {
+            LOCK(m_results_mutex);
+            for (const auto& [nTime, index] : found) {
+                job.hits[nTime].push_back(index);
+                if (m_stop_on_first_hit && nTime == job.nTimeFrom) m_stopped = true;
+            }
+        }
+
+        --m_chunks_left;
+
+        Queue& own = *m_queues[id];
+        LOCK(own.mutex);
+        own.stats.kernels += kernels.size() * job.nSlots;
+        own.stats.chunks += 1;
+        own.stats.stolen += stolen;
+        own.stats.busy += std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - time_start);
+    }
+}
+
+bool StakeSearchPool::Search(std::vector<StakeSearchJob>& jobs, uint32_t nSlotSpacing, bool stop_on_first_hit, const std::atomic<bool>& interrupt)
+{
+    m_jobs = &jobs;
+    m_slot_spacing = nSlotSpacing;
+    m_stop_on_first_hit = stop_on_first_hit;
+    m_interrupt = &interrupt;
+    m_stopped = false;
+
+    // Deal the chunks of all the jobs round-robin, so that every thread starts
+    // with a share of every wallet
+    size_t next_queue{0};
+    size_t chunks{0};
+    for (size_t job = 0; job < jobs.size(); ++job) {
+        jobs[job].hits.clear();
+        const size_t size = jobs[job].kernels->size();
+        for (size_t begin = 0; begin < size; begin += STAKE_SEARCH_CHUNK_SIZE) {
+            Queue& queue = *m_queues[next_queue];
+            next_queue = (next_queue + 1) % m_queues.size();
+            LOCK(queue.mutex);
+            queue.chunks.push_back({job, begin, std::min(begin + STAKE_SEARCH_CHUNK_SIZE, size)});
+            ++chunks;
+        }
+    }
+    m_chunks_left = chunks;
+
+    {
+        LOCK(m_mutex);
+        ++m_generation;
+        m_busy = m_threads.size();
+    }
+    m_work_cv.notify_all();
+    Work(0);
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_done_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_busy == 0; });
+    }
+
+    // Chunks left over by a stopped search
+    for (const auto& queue : m_queues) {
+        LOCK(queue->mutex);
+        queue->chunks.clear();
+    }
+    for (StakeSearchJob& job : jobs) {
+        for (auto& [nTime, indexes] : job.hits) {
+            std::sort(indexes.begin(), indexes.end());
+        }
+    }
+    m_jobs = nullptr;
+    m_interrupt = nullptr;
+    // A search stopped on a hit in the last chunk still evaluated every kernel
+    return m_chunks_left == 0;
+}
+
+std::vector<StakeSearchStats> StakeSearchPool::GetStats() const
+{
+    std::vector<StakeSearchStats> stats;
+    for (const auto& queue : m_queues) {
+        LOCK(queue->mutex);
+        stats.push_back(queue->stats);
+    }
+    return stats;
+}
+} // namespace node
@@ -0,0 +1,116 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_STAKE_SEARCH_H
+#define BITCOIN_NODE_STAKE_SEARCH_H
+
+#include <sync.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct CStakeKernel;
+
+namespace node {
+//! -stakethreads default
+static constexpr int DEFAULT_STAKE_THREADS{1};
+//! Maximum number of kernel search threads
+static constexpr int MAX_STAKE_THREADS{64};
+//! Number of kernels in a unit of work of the search
+static constexpr size_t STAKE_SEARCH_CHUNK_SIZE{4096};
+
+/** Kernels of one wallet to evaluate in nSlots timestamp slots starting at nTimeFrom */
+struct StakeSearchJob
+{
+    const std::vector<CStakeKernel>* kernels{nullptr};
+    uint32_t nTimeFrom{0};
+    unsigned int nSlots{0};
+    //! Indexes into kernels meeting the target, per coinstake time, in increasing order
+    std::map<uint32_t, std::vector<size_t>> hits;
+};
+
+/** Work done by one search thread since it was started */
+struct StakeSearchStats
+{
+    //! Kernel hashes evaluated
+    uint64_t kernels{0};
+    //! Chunks evaluated, and how many of them were taken from another thread
+    uint64_t chunks{0};
+    uint64_t stolen{0};
+    std::chrono::microseconds busy{0};
+};
+
+/**
+ * Threads evaluating stake kernels for the stake miner. Each search splits the
+ * kernels of all its jobs into chunks spread over per-thread queues. A thread
+ * works through its own queue first and then steals from the back of the
+ * others, so that all the threads stay busy until every kernel of every slot
+ * is evaluated, however the coins are spread over the wallets.
+ *
+ * The thread calling Search() takes part as thread 0, -stakethreads=1 does not
+ * start any other thread.
+ */
+class StakeSearchPool
+{
+public:
+    explicit StakeSearchPool(int threads);
+    ~StakeSearchPool();
+
+    /** Fill the hits of the jobs. The search stops early when interrupt is set or,
+     *  with stop_on_first_hit, once a kernel is found in the first slot of a job.
+     *  Returns false if it stopped before evaluating every kernel. */
+    bool Search(std::vector<StakeSearchJob>& jobs, uint32_t nSlotSpacing, bool stop_on_first_hit, const std::atomic<bool>& interrupt) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex, !m_results_mutex);
+
+    size_t Threads() const { return m_queues.size(); }
+    std::vector<StakeSearchStats> GetStats() const;
+
+private:
+    struct Chunk {
+        size_t job;
+        size_t begin;
+        size_t end;
+    };
+    struct Queue {
+        mutable Mutex mutex;
+        std::deque<Chunk> chunks GUARDED_BY(mutex);
+        StakeSearchStats stats GUARDED_BY(mutex);
+    };
+
+    void ThreadSearch(size_t id) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex, !m_results_mutex);
+    /** Evaluate chunks until there are none left or the search is stopped */
+    void Work(size_t id) EXCLUSIVE_LOCKS_REQUIRED(!m_results_mutex);
+    bool Take(size_t id, Chunk& chunk, bool& stolen);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    Mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    uint64_t m_generation GUARDED_BY(m_mutex){0};
+    //! Threads other than the caller still working on the current search
+    size_t m_busy GUARDED_BY(m_mutex){0};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    // The current search, set before its generation starts
+    std::vector<StakeSearchJob>* m_jobs{nullptr};
+    uint32_t m_slot_spacing{0};
+    bool m_stop_on_first_hit{false};
+    const std::atomic<bool>* m_interrupt{nullptr};
+    std::atomic<bool> m_stopped{false};
+    //! Chunks of the current search not evaluated yet
+    std::atomic<size_t> m_chunks_left{0};
+    Mutex m_results_mutex;
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_STAKE_SEARCH_H
@@ -0,0 +1,64 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/stake_seen.h>
+
+#include <crypto/siphash.h>
+#include <primitives/block.h>
+#include <random.h>
+
+namespace node {
+StakeSeenIndex::StakeSeenIndex(size_t max_stakes)
+    : m_k0(GetRand<uint64_t>()), m_k1(GetRand<uint64_t>()),
+      m_max_stakes(max_stakes) {}
+
+bool StakeSeenIndex::GetStake(const CBlock& block, COutPoint& prevout, uint32_t& nTime)
+{
+    if (!block.IsProofOfStake() || block.vtx.size() < 2 || !block.vtx[1]->IsCoinStake()) {
+        return false;
+    }
+    prevout = block.vtx[1]->vin[0].prevout;
+    nTime = block.vtx[1]->nTime ? block.vtx[1]->nTime : block.nTime;
+    return true;
+}
+
+uint64_t StakeSeenIndex::StakeKey(const COutPoint& prevout, uint32_t nTime) const
+{
+    return CSipHasher(m_k0, m_k1)
+        .Write(prevout.hash.GetUint64(0))
+        .Write(prevout.hash.GetUint64(1))
+        .Write(prevout.hash.GetUint64(2))
+        .Write(prevout.hash.GetUint64(3))
+        .Write((uint64_t{prevout.n} << 32) | nTime)
+        .Finalize();
+}
+
+uint64_t StakeSeenIndex::BlockKey(const uint256& block_hash) const
+{
+    return SipHashUint256(m_k0, m_k1, block_hash);
+}
+
+bool StakeSeenIndex::IsDuplicate(const COutPoint& prevout, uint32_t nTime, const uint256& block_hash) const
+{
+    const auto it{m_stakes.find(StakeKey(prevout, nTime))};
+    return it != m_stakes.end() && it->second != BlockKey(block_hash);
+}
+
+void StakeSeenIndex::Add(const COutPoint& prevout, uint32_t nTime, const uint256& block_hash)
+{
+    const uint64_t key{StakeKey(prevout, nTime)};
+    if (!m_stakes.emplace(key, BlockKey(block_hash)).second) return;
+    m_stakes_order.push_back(key);
+    while (m_stakes_order.size() > m_max_stakes) {
+        m_stakes.erase(m_stakes_order.front());
+        m_stakes_order.pop_front();
+    }
+}
+
+void StakeSeenIndex::Clear()
+{
+    m_stakes.clear();
+    m_stakes_order.clear();
+}
+} // namespace node
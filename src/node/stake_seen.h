@@ -0,0 +1,64 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_STAKE_SEEN_H
+#define BITCOIN_NODE_STAKE_SEEN_H
+
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+class CBlock;
+
+namespace node {
+//! Number of stakes remembered by StakeSeenIndex, about 3.5 days of blocks
+static constexpr size_t DEFAULT_MAX_SEEN_STAKES{20000};
+
+/**
+ * Bounded index of the stakes (kernel prevout and coinstake time) used by the
+ * proof-of-stake blocks we have connected, like setStakeSeen of the original
+ * clients. Only stakes whose kernel and signature have been checked are added,
+ * so a block spending someone else's stake cannot claim it first. A stake can
+ * only be spent by one block per chain, so a second block reusing it is either
+ * a fork sibling or an attempt to make us store and validate many blocks for
+ * the price of one kernel.
+ *
+ * Stakes and block hashes are kept as salted 64-bit hashes and the oldest
+ * entries are dropped once the index is full.
+ */
+class StakeSeenIndex
+{
+public:
+    explicit StakeSeenIndex(size_t max_stakes = DEFAULT_MAX_SEEN_STAKES);
+
+    /** Return the coinstake kernel prevout and time of a proof-of-stake block,
+     *  false if the block has no coinstake. */
+    static bool GetStake(const CBlock& block, COutPoint& prevout, uint32_t& nTime);
+
+    /** Whether the stake has been seen before in a block other than block_hash */
+    bool IsDuplicate(const COutPoint& prevout, uint32_t nTime, const uint256& block_hash) const;
+    /** Remember the stake as used by block_hash, unless it is already known */
+    void Add(const COutPoint& prevout, uint32_t nTime, const uint256& block_hash);
+
+    size_t Size() const { return m_stakes.size(); }
+    void Clear();
+
+private:
+    uint64_t StakeKey(const COutPoint& prevout, uint32_t nTime) const;
+    uint64_t BlockKey(const uint256& block_hash) const;
+
+    const uint64_t m_k0, m_k1;
+    const size_t m_max_stakes;
+
+    //! Stake key to block key of the first block seen with it
+    std::unordered_map<uint64_t, uint64_t> m_stakes;
+    std::deque<uint64_t> m_stakes_order;
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_STAKE_SEEN_H
@@ -0,0 +1,34 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/stake_stats.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace node {
+std::string StakeStageName(StakeStage stage)
+{
+    switch (stage) {
+    case StakeStage::SNAPSHOT: return "snapshot";
+    case StakeStage::KERNEL_SEARCH: return "kernel_search";
+    case StakeStage::TEMPLATE: return "template";
+    case StakeStage::SIGN: return "sign";
+    case StakeStage::PROCESS_BLOCK: return "process_block";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+void LatencyHistogram::Add(std::chrono::microseconds latency)
+{
+    latency = std::max(latency, std::chrono::microseconds{0});
+    const size_t bucket = CountBits(static_cast<uint64_t>(latency.count()));
+    ++m_buckets[std::min(bucket, BUCKETS - 1)];
+    ++m_count;
+    m_total += latency;
+    m_max = std::max(m_max, latency);
+}
+} // namespace node
@@ -0,0 +1,83 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_STAKE_STATS_H
+#define BITCOIN_NODE_STAKE_STATS_H
+
+#include <node/stake_search.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace node {
+/** Parts of a staking round, timed separately */
+enum class StakeStage : uint8_t {
+    SNAPSHOT,       //!< Taking the stake candidates of the wallets
+    KERNEL_SEARCH,  //!< Hashing the kernels of the look-ahead slots
+    TEMPLATE,       //!< Selecting the transactions and creating the coinstake and block
+    SIGN,           //!< Signing the block
+    PROCESS_BLOCK,  //!< Checking and connecting the block
+};
+static constexpr size_t STAKE_STAGE_COUNT{5};
+//! Depth at which a staked block stops being checked for a reorg
+static constexpr int STAKE_CONFIRM_DEPTH{10};
+
+std::string StakeStageName(StakeStage stage);
+
+/** Latencies in power of two buckets of microseconds, bucket i counting
+ *  latencies of less than 2^i us not counted by bucket i - 1 */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t BUCKETS{24};
+
+    void Add(std::chrono::microseconds latency);
+
+    uint64_t Count() const { return m_count; }
+    std::chrono::microseconds Total() const { return m_total; }
+    std::chrono::microseconds Max() const { return m_max; }
+    const std::array<uint64_t, BUCKETS>& Buckets() const { return m_buckets; }
+    /** Upper bound of a bucket, the last one also counts any longer latency */
+    static std::chrono::microseconds BucketLimit(size_t bucket) { return std::chrono::microseconds{int64_t{1} << bucket}; }
+
+private:
+    std::array<uint64_t, BUCKETS> m_buckets{};
+    uint64_t m_count{0};
+    std::chrono::microseconds m_total{0};
+    std::chrono::microseconds m_max{0};
+};
+
+/** Counters of the stake miner since the node started */
+struct StakeMinerStats
+{
+    //! Latency of the rounds that searched for kernels, from the snapshots to the block
+    LatencyHistogram round;
+    std::array<LatencyHistogram, STAKE_STAGE_COUNT> stages;
+
+    uint64_t rounds{0};
+    //! Kernels hashed, one per coin and slot, and the time spent on it
+    uint64_t kernels_evaluated{0};
+    std::chrono::microseconds kernel_search_time{0};
+    //! Coins meeting the target in the current slot
+    uint64_t kernels_found{0};
+    uint64_t slots_searched{0};
+    //! Slots that passed while the staking thread was busy or late
+    uint64_t slots_missed{0};
+    //! Blocks built on a tip that was no longer the tip when they were done
+    uint64_t stale_templates{0};
+    uint64_t blocks_staked{0};
+    uint64_t blocks_rejected{0};
+    //! Staked blocks found out of the active chain, or buried in it
+    uint64_t blocks_orphaned{0};
+    uint64_t blocks_confirmed{0};
+    //! Per search thread, empty when not staking
+    std::vector<StakeSearchStats> search_threads;
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_STAKE_STATS_H
@@ -0,0 +1,142 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/stake_weight.h>
+
+#include <chain.h>
+#include <kernel/chain.h>
+
+#include <algorithm>
+
+namespace node {
+StakeWeightEstimator::StakeWeightEstimator(unsigned int nStakeTimestampMask, const std::vector<size_t>& windows)
+    : m_stake_timestamp_mask(nStakeTimestampMask)
+{
+    LOCK(m_mutex);
+    for (const size_t blocks : windows) {
+        if (blocks) m_windows.push_back({blocks});
+    }
+    m_entries.resize(m_windows.empty() ? 1 : std::max_element(m_windows.begin(), m_windows.end(), [](const Window& a, const Window& b) { return a.blocks < b.blocks; })->blocks);
+}
+
+bool StakeWeightEstimator::MakeEntry(const CBlockIndex* pindex, Entry& entry)
+{
+    if (!pindex->IsProofOfStake() || !pindex->pprev) return false;
+    const CBlockIndex* pindexPrevStake = GetLastBlockIndex(pindex->pprev, true);
+    if (!pindexPrevStake->IsProofOfStake()) return false;
+    entry.nHeight = pindex->nHeight;
+    entry.kernels = GetDifficulty(pindex) * 4294967296.0;
+    entry.spacing = int64_t{pindex->nTime} - pindexPrevStake->nTime;
+    return true;
+}
+
+void StakeWeightEstimator::Push(const Entry& entry)
+{
+    for (Window& window : m_windows) {
+        if (m_size >= window.blocks) {
+            const Entry& old = At(m_size - window.blocks);
+            window.kernels -= old.kernels;
+            window.spacing -= old.spacing;
+        }
+        window.kernels += entry.kernels;
+        window.spacing += entry.spacing;
+    }
+    if (m_size == m_entries.size()) {
+        m_start = (m_start + 1) % m_entries.size();
+        --m_size;
+    }
+    m_entries[(m_start + m_size) % m_entries.size()] = entry;
+    ++m_size;
+}
+
+void StakeWeightEstimator::Pop()
+{
+    const Entry entry = At(--m_size);
+    for (Window& window : m_windows) {
+        window.kernels -= entry.kernels;
+        window.spacing -= entry.spacing;
+        // The entry that comes back into the window, if the buffer still holds it
+        if (m_size >= window.blocks) {
+            const Entry& old = At(m_size - window.blocks);
+            window.kernels += old.kernels;
+            window.spacing += old.spacing;
+        }
+    }
+}
+
+void StakeWeightEstimator::Init(const CBlockIndex* tip)
+{
+    std::vector<Entry> entries;
+    Entry entry;
+    for (const CBlockIndex* pindex = tip ? GetLastBlockIndex(tip, true) : nullptr; pindex && entries.size() < m_entries.size() && MakeEntry(pindex, entry);) {
+        entries.push_back(entry);
+        pindex = GetLastBlockIndex(pindex->pprev, true);
+    }
+
+    LOCK(m_mutex);
+    m_start = m_size = 0;
+    for (Window& window : m_windows) {
+        window.kernels = 0;
+        window.spacing = 0;
+    }
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        Push(*it);
+    }
+}
+
+double StakeWeightEstimator::GetKernelsPS(size_t window) const
+{
+    LOCK(m_mutex);
+    double kernels = 0;
+    int64_t spacing = 0;
+    const auto it = std::find_if(m_windows.begin(), m_windows.end(), [&](const Window& w) { return w.blocks == window; });
+    if (it != m_windows.end()) {
+        kernels = it->kernels;
+        spacing = it->spacing;
+    } else {
+        for (size_t i = m_size - std::min(window, m_size); i < m_size; ++i) {
+            kernels += At(i).kernels;
+            spacing += At(i).spacing;
+        }
+    }
+
+    if (spacing <= 0) return 0;
+    return kernels / spacing * (m_stake_timestamp_mask + 1);
+}
+
+std::vector<size_t> StakeWeightEstimator::GetWindows() const
+{
+    LOCK(m_mutex);
+    std::vector<size_t> windows;
+    for (const Window& window : m_windows) {
+        windows.push_back(window.blocks);
+    }
+    return windows;
+}
+
+size_t StakeWeightEstimator::Size() const
+{
+    LOCK(m_mutex);
+    return m_size;
+}
+
+void StakeWeightEstimator::BlockConnected(ChainstateRole role, const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex)
+{
+    // Only follow the chainstate the node reports as its tip
+    if (role == ChainstateRole::BACKGROUND) return;
+    Entry entry;
+    if (!MakeEntry(pindex, entry)) return;
+    LOCK(m_mutex);
+    if (m_size && At(m_size - 1).nHeight >= entry.nHeight) return;
+    Push(entry);
+}
+
+void StakeWeightEstimator::BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex)
+{
+    LOCK(m_mutex);
+    if (m_size && At(m_size - 1).nHeight == pindex->nHeight) {
+        Pop();
+    }
+}
+} // namespace node
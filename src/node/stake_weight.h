@@ -0,0 +1,84 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_STAKE_WEIGHT_H
+#define BITCOIN_NODE_STAKE_WEIGHT_H
+
+#include <sync.h>
+#include <validationinterface.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CBlockIndex;
+
+namespace node {
+//! Windows, in proof-of-stake blocks, of the network stake weight estimates (-stakeweightwindow)
+static const std::vector<size_t> DEFAULT_STAKE_WEIGHT_WINDOWS{72, 720, 5040};
+//! Window used by getstakinginfo netstakeweight and the GUI
+static constexpr size_t DEFAULT_STAKE_WEIGHT_WINDOW{72};
+//! Largest -stakeweightwindow, about a month of blocks
+static constexpr size_t MAX_STAKE_WEIGHT_WINDOW{50000};
+
+/**
+ * Rolling estimate of the kernels tried per second by the network, from the
+ * difficulty and spacing of the last proof-of-stake blocks of the active chain.
+ *
+ * A ring buffer keeps one entry per proof-of-stake block, updated on
+ * BlockConnected/BlockDisconnected, with running sums for every configured
+ * window so that queries take neither cs_main nor a walk of the block index.
+ */
+class StakeWeightEstimator final : public CValidationInterface
+{
+public:
+    StakeWeightEstimator(unsigned int nStakeTimestampMask, const std::vector<size_t>& windows = DEFAULT_STAKE_WEIGHT_WINDOWS);
+
+    /** Fill the buffer from the proof-of-stake blocks before and including tip */
+    void Init(const CBlockIndex* tip) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Kernels tried per second over the last window proof-of-stake blocks,
+     *  like GetPoSKernelPS of the original clients. O(1) for configured windows. */
+    double GetKernelsPS(size_t window = DEFAULT_STAKE_WEIGHT_WINDOW) const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Configured windows, in proof-of-stake blocks */
+    std::vector<size_t> GetWindows() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Number of proof-of-stake blocks held */
+    size_t Size() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Overridden from CValidationInterface. */
+    void BlockConnected(ChainstateRole role, const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+private:
+    struct Entry {
+        int nHeight;
+        //! Expected number of kernels tried to find the block
+        double kernels;
+        //! Seconds since the previous proof-of-stake block
+        int64_t spacing;
+    };
+    struct Window {
+        size_t blocks;
+        double kernels{0};
+        int64_t spacing{0};
+    };
+
+    static bool MakeEntry(const CBlockIndex* pindex, Entry& entry);
+    const Entry& At(size_t i) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_entries[(m_start + i) % m_entries.size()]; }
+    void Push(const Entry& entry) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Pop() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    const unsigned int m_stake_timestamp_mask;
+    mutable Mutex m_mutex;
+    //! Ring buffer, oldest entry at m_start
+    std::vector<Entry> m_entries GUARDED_BY(m_mutex);
+    size_t m_start GUARDED_BY(m_mutex){0};
+    size_t m_size GUARDED_BY(m_mutex){0};
+    std::vector<Window> m_windows GUARDED_BY(m_mutex);
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_STAKE_WEIGHT_H
@@ -32,14 +32,21 @@ public:
     //! during snapshot load to estimate progress of UTXO set reconstruction.
     uint64_t m_coins_count = 0;
 
+    //! The stake modifier of the base block. It is only computed by ConnectBlock,
+    //! so a snapshot chainstate could not check the kernel of the next block
+    //! without it.
+    uint256 m_stake_modifier;
+
     SnapshotMetadata() { }
     SnapshotMetadata(
         const uint256& base_blockhash,
-        uint64_t coins_count) :
+        uint64_t coins_count,
+        const uint256& stake_modifier = {}) :
             m_base_blockhash(base_blockhash),
-            m_coins_count(coins_count) { }
+            m_coins_count(coins_count),
+            m_stake_modifier(stake_modifier) { }
 
-    SERIALIZE_METHODS(SnapshotMetadata, obj) { READWRITE(obj.m_base_blockhash, obj.m_coins_count); }
+    SERIALIZE_METHODS(SnapshotMetadata, obj) { READWRITE(obj.m_base_blockhash, obj.m_coins_count, obj.m_stake_modifier); }
 };
 
 //! The file in the snapshot chainstate dir which stores the base blockhash. This is
@@ -0,0 +1 @@
+#define BUILD_GIT_COMMIT "ba2911907e67-dirty"
@@ -20,6 +20,7 @@
 #include <primitives/transaction.h>
 #include <script/sign.h>
 #include <consensus/consensus.h>
+#include <crypto/common.h>
 #include <stdio.h>
 
 using namespace std;
@@ -122,8 +123,56 @@ bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, unsigned int nBits, uin
     return true;
 }
 
+// Precompute the parts of the kernel hash that do not depend on nTimeTx.
+// The serialized kernel is nStakeModifier (32) + txPrev.nTime (4) + txPrev.vout.hash (32)
+// + txPrev.vout.n (4) + nTimeTx (4), so the first SHA256 block only depends on the candidate.
+bool PrepareStakeKernel(const uint256& nStakeModifier, unsigned int nBits, uint32_t blockFromTime, CAmount prevoutValue, const COutPoint& prevout, CStakeKernel& kernel)
+{
+    if (prevoutValue == 0)
+        return false;
+
+    kernel.bnWeightedTarget.SetCompact(nBits);
+    kernel.bnWeightedTarget *= arith_uint256(prevoutValue);
+    kernel.blockFromTime = blockFromTime;
+
+    unsigned char head[64];
+    memcpy(head, nStakeModifier.begin(), 32);
+    WriteLE32(head + 32, blockFromTime);
+    memcpy(head + 36, prevout.hash.begin(), 28);
+    kernel.midstate.Reset().Write(head, sizeof(head));
+
+    memcpy(kernel.tail, prevout.hash.begin() + 28, 4);
+    WriteLE32(kernel.tail + 4, prevout.n);
+    return true;
+}
+
+// Same result as CheckStakeKernelHash() for the prepared candidate, but only
+// hashes the last kernel block and does not recompute the weighted target
+bool CheckStakeKernelHash(const CStakeKernel& kernel, unsigned int nTimeTx)
+{
+    if (nTimeTx < kernel.blockFromTime)
+        return false;
+
+    unsigned char time[4];
+    WriteLE32(time, nTimeTx);
+
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256(kernel.midstate).Write(kernel.tail, sizeof(kernel.tail)).Write(time, sizeof(time)).Finalize(hash);
+    CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+
+    return UintToArith256(uint256(hash)) <= kernel.bnWeightedTarget;
+}
+
+void CheckStakeKernelHashBatch(Span<const CStakeKernel> kernels, unsigned int nTimeTx, std::vector<size_t>& hits)
+{
+    for (size_t i = 0; i < kernels.size(); i++) {
+        if (CheckStakeKernelHash(kernels[i], nTimeTx))
+            hits.push_back(i);
+    }
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, BlockValidationState& state, CCoinsViewCache& view, unsigned int nTimeTx)
+bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, BlockValidationState& state, CCoinsViewCache& view, unsigned int nTimeTx, bool fCheckSignature)
 {
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString());
@@ -148,7 +197,7 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned
     }
 
     // Verify signature
-    if (!VerifySignature(coinPrev, txin.prevout.hash, tx, 0, SCRIPT_VERIFY_NONE))
+    if (fCheckSignature && !VerifySignature(coinPrev, txin.prevout.hash, tx, 0, SCRIPT_VERIFY_NONE))
         return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "stake-verify-signature-failed", strprintf("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString()));
 
     if (!CheckStakeKernelHash(pindexPrev, nBits, (coinPrev.nTime ? coinPrev.nTime : blockFrom->nTime), coinPrev.out.nValue, txin.prevout, nTimeTx, LogInstance().WillLogCategory(BCLog::COINSTAKE)))
@@ -18,7 +18,9 @@
 #include <hash.h>
 #include <timedata.h>
 #include <chainparams.h>
+#include <crypto/sha256.h>
 #include <script/sign.h>
+#include <span.h>
 #include <consensus/consensus.h>
 #include <stdint.h>
 
@@ -34,12 +36,27 @@ struct CStakeCache{
     CAmount amount;
 };
 
+/** Kernel hash state of a stake candidate for a fixed stake modifier and target.
+ *  Only nTimeTx varies while searching, so the SHA256 midstate over the first
+ *  64 bytes of the kernel and the weighted target are computed once. */
+struct CStakeKernel {
+    CSHA256 midstate;
+    unsigned char tail[8];
+    arith_uint256 bnWeightedTarget;
+    uint32_t blockFromTime;
+};
+
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
 bool CheckStakeBlockTimestamp(int64_t nTimeBlock);
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTime, const COutPoint& prevout, CCoinsViewCache& view);
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTime, const COutPoint& prevout, CCoinsViewCache& view, const std::map<COutPoint, CStakeCache>& cache);
 bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, unsigned int nBits, uint32_t blockFromTime, CAmount prevoutValue, const COutPoint& prevout, unsigned int nTimeTx, bool fPrintProofOfStake = false);
-bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, BlockValidationState& state, CCoinsViewCache& view, unsigned int nTimeTx);
+bool PrepareStakeKernel(const uint256& nStakeModifier, unsigned int nBits, uint32_t blockFromTime, CAmount prevoutValue, const COutPoint& prevout, CStakeKernel& kernel);
+bool CheckStakeKernelHash(const CStakeKernel& kernel, unsigned int nTimeTx);
+void CheckStakeKernelHashBatch(Span<const CStakeKernel> kernels, unsigned int nTimeTx, std::vector<size_t>& hits);
+/** Check the kernel of a coinstake. The signature of the kernel input is only checked if fCheckSignature
+ *  is set, ConnectBlock skips it with the other script checks under assumevalid. */
+bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, BlockValidationState& state, CCoinsViewCache& view, unsigned int nTimeTx, bool fCheckSignature = true);
 void CacheKernel(std::map<COutPoint, CStakeCache>& cache, const COutPoint& prevout, CBlockIndex* pindexPrev, CCoinsViewCache& view);
 #endif // BLACKCOIN_POS_H
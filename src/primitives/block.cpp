@@ -11,6 +11,90 @@
 #include <crypto/common.h>
 #include <crypto/scrypt.h>
 
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+/**
+ * Process-wide cache of scrypt header hashes.
+ *
+ * Headers of the scrypt era (nVersion <= 6) have their hash computed many times
+ * on the way through header sync, AcceptBlockHeader, CheckBlock and reindex,
+ * usually on different copies of the same header. Entries are keyed on the full
+ * 80 header bytes, so a header that is modified afterwards (e.g. a nonce update
+ * while mining) never sees a stale hash.
+ */
+class PoWHashCache
+{
+    static constexpr size_t HEADER_SIZE = 80;
+    static constexpr size_t NUM_SETS = 1 << 12;
+    static constexpr size_t NUM_WAYS = 4;
+
+    struct Entry {
+        unsigned char header[HEADER_SIZE];
+        uint256 hash;
+        bool valid{false};
+    };
+
+    struct Set {
+        Entry ways[NUM_WAYS];
+        //! Way to evict next when the set is full
+        uint8_t next{0};
+    };
+
+    std::mutex m_mutex;
+    std::vector<Set> m_sets;
+
+    Set& GetSet(const unsigned char* header)
+    {
+        // Merkle root and nonce are as good as random and cheap to read.
+        return m_sets[(ReadLE64(header + 36) ^ ReadLE32(header + 76)) & (NUM_SETS - 1)];
+    }
+
+public:
+    bool Get(const unsigned char* header, uint256& hash)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_sets.empty()) return false;
+        for (const Entry& entry : GetSet(header).ways) {
+            if (entry.valid && memcmp(entry.header, header, HEADER_SIZE) == 0) {
+                hash = entry.hash;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Put(const unsigned char* header, const uint256& hash)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_sets.empty()) m_sets.resize(NUM_SETS);
+        Set& set = GetSet(header);
+        Entry* slot = nullptr;
+        for (Entry& entry : set.ways) {
+            if (!entry.valid || memcmp(entry.header, header, HEADER_SIZE) == 0) {
+                slot = &entry;
+                break;
+            }
+        }
+        if (!slot) {
+            slot = &set.ways[set.next];
+            set.next = (set.next + 1) % NUM_WAYS;
+        }
+        memcpy(slot->header, header, HEADER_SIZE);
+        slot->hash = hash;
+        slot->valid = true;
+    }
+};
+
+PoWHashCache& GetPoWHashCache()
+{
+    static PoWHashCache cache;
+    return cache;
+}
+} // namespace
+
 uint256 CBlockHeader::GetHash() const
 {
     if (nVersion > 6)
@@ -20,11 +104,33 @@ uint256 CBlockHeader::GetHash() const
 
 uint256 CBlockHeader::GetPoWHash() const
 {
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(&nVersion);
     uint256 thash;
+    if (GetPoWHashCache().Get(header, thash)) return thash;
     scrypt_1024_1_1_256(BEGIN(nVersion), BEGIN(thash));
+    GetPoWHashCache().Put(header, thash);
     return thash;
 }
 
+void CachePoWHashes(const std::vector<const CBlockHeader*>& headers)
+{
+    std::vector<char> input;
+    input.reserve(headers.size() * 80);
+    for (const CBlockHeader* header : headers) {
+        uint256 thash;
+        if (GetPoWHashCache().Get(reinterpret_cast<const unsigned char*>(&header->nVersion), thash)) continue;
+        input.insert(input.end(), BEGIN(header->nVersion), BEGIN(header->nVersion) + 80);
+    }
+    const size_t count = input.size() / 80;
+    std::vector<char> output(count * 32);
+    scrypt_1024_1_1_256_multi(input.data(), output.data(), count);
+    for (size_t i = 0; i < count; ++i) {
+        uint256 thash;
+        memcpy(thash.begin(), output.data() + i * 32, 32);
+        GetPoWHashCache().Put(reinterpret_cast<const unsigned char*>(input.data() + i * 80), thash);
+    }
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -64,6 +64,7 @@ public:
 
     uint256 GetHash() const;
 
+    //! scrypt hash of the header; results are cached process-wide, keyed on the header bytes
     uint256 GetPoWHash() const;
 
     NodeSeconds Time() const
@@ -78,6 +79,10 @@ public:
 };
 
 
+/** Compute the scrypt hashes of a run of headers in one batch, using the multi-lane
+ *  scrypt implementation where available, so that later GetPoWHash() calls hit the cache. */
+void CachePoWHashes(const std::vector<const CBlockHeader*>& headers);
+
 class CBlock : public CBlockHeader
 {
 public:
@@ -55,7 +55,8 @@ struct CCoin {
     CTxOut out;
 
     CCoin() : nHeight(0) {}
-    explicit CCoin(Coin&& in) : nHeight(in.nHeight), out(std::move(in.out)) {}
+    // Coins only in the mempool keep reporting the 0x7FFFFFFF height of the BIP64 format
+    explicit CCoin(Coin&& in) : nHeight(in.nHeight == MEMPOOL_HEIGHT ? 0x7FFFFFFF : in.nHeight), out(std::move(in.out)) {}
 
     SERIALIZE_METHODS(CCoin, obj)
     {
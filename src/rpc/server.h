@@ -179,8 +179,6 @@ bool IsDeprecatedRPCEnabled(const std::string& method);
 
 extern CRPCTable tableRPC;
 
-extern double GetPoSKernelPS(ChainstateManager& chainman);
-
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
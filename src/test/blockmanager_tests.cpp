@@ -9,13 +9,17 @@
 #include <node/kernel_notifications.h>
 #include <script/solver.h>
 #include <primitives/block.h>
+#include <tinyformat.h>
 #include <util/chaintype.h>
 #include <validation.h>
 
+#include <fstream>
+
 #include <boost/test/unit_test.hpp>
 #include <test/util/logging.h>
 #include <test/util/setup_common.h>
 
+using node::BLOCK_INDEX_RECORDS_PER_CHUNK;
 using node::BLOCK_SERIALIZATION_HEADER_SIZE;
 using node::BlockManager;
 using node::KernelNotifications;
@@ -204,4 +208,100 @@ BOOST_AUTO_TEST_CASE(blockmanager_flush_block_file)
 }
 */
 
+BOOST_FIXTURE_TEST_CASE(blockmanager_block_index_snapshot, TestingSetup)
+{
+    LOCK(::cs_main);
+    auto& chainman{*Assert(m_node.chainman)};
+    auto& blockman{chainman.m_blockman};
+
+    // Extend the block index with headers, with a fork every so often, so
+    // that the snapshot has more than one chunk
+    const CBlockIndex* prev{chainman.ActiveTip()};
+    for (size_t i{0}; blockman.m_block_index.size() <= BLOCK_INDEX_RECORDS_PER_CHUNK + 1000; ++i) {
+        CBlockHeader header{prev->GetBlockHeader()};
+        header.hashPrevBlock = prev->GetBlockHash();
+        header.nTime = prev->nTime + 1;
+        header.nNonce = uint32_t(i);
+        CBlockIndex* pindex{blockman.AddToBlockIndex(header, chainman.m_best_header, /*fSetAsProofOfStake=*/i % 2 == 0)};
+        if (i % 1000 != 0) prev = pindex;
+    }
+    chainman.ActiveChainstate().ForceFlushStateToDisk();
+    const fs::path snapshot_path{m_args.GetBlocksDirPath() / node::BLOCK_INDEX_SNAPSHOT_FILENAME};
+
+    // Load the block index in a second block manager sharing the database
+    const CBlockIndex& tip{*Assert(chainman.ActiveTip())};
+    const auto load_block_index{[&](BlockManager& loaded, const uint256& best_block) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+        loaded.m_block_tree_db = std::move(blockman.m_block_tree_db);
+        BOOST_CHECK(loaded.LoadBlockIndexDB(/*snapshot_blockhash=*/std::nullopt, best_block));
+        blockman.m_block_tree_db = std::move(loaded.m_block_tree_db);
+    }};
+    const auto check_block_index{[&](BlockManager& loaded) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+        BOOST_REQUIRE_EQUAL(loaded.m_block_index.size(), blockman.m_block_index.size());
+        for (const auto& [hash, index] : blockman.m_block_index) {
+            const CBlockIndex* loaded_index{loaded.LookupBlockIndex(hash)};
+            BOOST_REQUIRE(loaded_index);
+            BOOST_CHECK_EQUAL(loaded_index->nHeight, index.nHeight);
+            BOOST_CHECK_EQUAL(loaded_index->nStatus, index.nStatus);
+            BOOST_CHECK_EQUAL(loaded_index->nTx, index.nTx);
+            BOOST_CHECK_EQUAL(loaded_index->nChainTx, index.nChainTx);
+            BOOST_CHECK_EQUAL(loaded_index->nFile, index.nFile);
+            BOOST_CHECK_EQUAL(loaded_index->nDataPos, index.nDataPos);
+            BOOST_CHECK_EQUAL(loaded_index->nUndoPos, index.nUndoPos);
+            BOOST_CHECK(loaded_index->GetBlockHeader().GetHash() == index.GetBlockHeader().GetHash());
+            BOOST_CHECK_EQUAL(loaded_index->nFlags, index.nFlags);
+            BOOST_CHECK(loaded_index->nStakeModifier == index.nStakeModifier);
+            BOOST_CHECK(loaded_index->nChainWork == index.nChainWork);
+            BOOST_CHECK(loaded_index->pprev == (index.pprev ? loaded.LookupBlockIndex(index.pprev->GetBlockHash()) : nullptr));
+            BOOST_CHECK(loaded_index->pskip == (index.pskip ? loaded.LookupBlockIndex(index.pskip->GetBlockHash()) : nullptr));
+        }
+    }};
+    const BlockManager::Options blockman_opts{
+        .chainparams = chainman.GetParams(),
+        .blocks_dir = m_args.GetBlocksDirPath(),
+        .notifications = chainman.GetNotifications(),
+    };
+
+    BOOST_CHECK(blockman.WriteBlockIndexSnapshot(tip));
+    BOOST_CHECK(fs::exists(snapshot_path));
+    {
+        BlockManager loaded{m_node.kernel->interrupt, blockman_opts};
+        ASSERT_DEBUG_LOG(strprintf("Loaded block index snapshot of %u entries", blockman.m_block_index.size()));
+        load_block_index(loaded, tip.GetBlockHash());
+        check_block_index(loaded);
+    }
+
+    // A snapshot written at another best block of the coins database, as when
+    // an older version kept the id but moved the tip, is ignored
+    {
+        BlockManager loaded{m_node.kernel->interrupt, blockman_opts};
+        ASSERT_DEBUG_LOG("Block index snapshot does not match the best block");
+        load_block_index(loaded, prev->GetBlockHash());
+        check_block_index(loaded);
+    }
+
+    // A corrupted snapshot is ignored
+    {
+        std::fstream file{snapshot_path, std::ios::in | std::ios::out | std::ios::binary};
+        file.seekp(-100, std::ios::end);
+        file.put(char(file.peek() ^ 1));
+    }
+    {
+        BlockManager loaded{m_node.kernel->interrupt, blockman_opts};
+        ASSERT_DEBUG_LOG("Block index snapshot is corrupted");
+        load_block_index(loaded, tip.GetBlockHash());
+        check_block_index(loaded);
+    }
+
+    // As is a snapshot of a block index written to since
+    BOOST_CHECK(blockman.WriteBlockIndexSnapshot(tip));
+    BOOST_CHECK(blockman.m_block_tree_db->ReadBlockIndexSnapshotId());
+    BOOST_CHECK(blockman.m_block_tree_db->WriteBatchSync({}, 0, {chainman.ActiveTip()}));
+    BOOST_CHECK(!blockman.m_block_tree_db->ReadBlockIndexSnapshotId());
+    {
+        BlockManager loaded{m_node.kernel->interrupt, blockman_opts};
+        load_block_index(loaded, tip.GetBlockHash());
+        check_block_index(loaded);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
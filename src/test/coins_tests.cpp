@@ -798,6 +798,41 @@ BOOST_AUTO_TEST_CASE(ccoins_add)
     CheckAddCoin(VALUE2, VALUE3, VALUE3, DIRTY|FRESH, DIRTY|FRESH, true );
 }
 
+static void CheckFetchedCoin(CAmount cache_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    Coin coin;
+    SetCoinsValue(VALUE3, coin);
+    test.cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    /* Check AddFetchedCoin behavior, adding a coin read from the base view to
+     * a cache view, and checking the resulting entry in the cache. A cached
+     * entry is never replaced.
+     *
+     *               Cache   Result  Cache        Result
+     *               Value   Value   Flags        Flags
+     */
+    CheckFetchedCoin(ABSENT, VALUE3, NO_ENTRY   , 0          );
+    CheckFetchedCoin(SPENT , SPENT , 0          , 0          );
+    CheckFetchedCoin(SPENT , SPENT , FRESH      , FRESH      );
+    CheckFetchedCoin(SPENT , SPENT , DIRTY      , DIRTY      );
+    CheckFetchedCoin(SPENT , SPENT , DIRTY|FRESH, DIRTY|FRESH);
+    CheckFetchedCoin(VALUE2, VALUE2, 0          , 0          );
+    CheckFetchedCoin(VALUE2, VALUE2, FRESH      , FRESH      );
+    CheckFetchedCoin(VALUE2, VALUE2, DIRTY      , DIRTY      );
+    CheckFetchedCoin(VALUE2, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
+}
+
 void CheckWriteCoins(CAmount parent_value, CAmount child_value, CAmount expected_value, char parent_flags, char child_flags, char expected_flags)
 {
     SingleEntryCacheTest test(ABSENT, parent_value, parent_flags);
@@ -1084,6 +1119,57 @@ BOOST_AUTO_TEST_CASE(ccoins_flush_behavior)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_flush_buffer)
+{
+    // A cache flushed to the coin database through a background write.
+    CCoinsViewDB db{{.path = "test", .cache_bytes = 1 << 23, .memory_only = true}, {}};
+    CCoinsViewFlushBuffer buffer{&db};
+    CCoinsViewCacheTest cache{&buffer};
+
+    const COutPoint spent{InsecureRand256(), 0};
+    const COutPoint added{InsecureRand256(), 0};
+    const COutPoint added_spent{InsecureRand256(), 0};
+    const Coin coin{MakeCoin()};
+
+    cache.AddCoin(spent, Coin{coin}, /*possible_overwrite=*/false);
+    const uint256 block1{InsecureRand256()};
+    cache.SetBestBlock(block1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(buffer.Wait());
+    BOOST_CHECK(db.HaveCoin(spent));
+    BOOST_CHECK(db.GetBestBlock() == block1);
+
+    // Spend a coin of the database, and add one spent before the flush, which
+    // the database never sees.
+    BOOST_CHECK(cache.SpendCoin(spent));
+    cache.AddCoin(added, Coin{coin}, /*possible_overwrite=*/false);
+    cache.AddCoin(added_spent, Coin{coin}, /*possible_overwrite=*/false);
+    BOOST_CHECK(cache.SpendCoin(added_spent));
+    const uint256 block2{InsecureRand256()};
+    cache.SetBestBlock(block2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    // Whether or not the write ended, the buffer serves the flushed state.
+    BOOST_CHECK(buffer.GetBestBlock() == block2);
+    BOOST_CHECK(!buffer.HaveCoin(spent));
+    BOOST_CHECK(!cache.HaveCoin(spent));
+    Coin read;
+    BOOST_CHECK(buffer.GetCoin(added, read));
+    BOOST_CHECK(read.out == coin.out);
+    BOOST_CHECK_EQUAL(read.nHeight, coin.nHeight);
+    BOOST_CHECK(!buffer.HaveCoin(added_spent));
+
+    BOOST_CHECK(buffer.Wait());
+    BOOST_CHECK(!buffer.WriteFailed());
+    BOOST_CHECK_EQUAL(buffer.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(db.GetBestBlock() == block2);
+    BOOST_CHECK(!db.HaveCoin(spent));
+    BOOST_CHECK(db.HaveCoin(added));
+    BOOST_CHECK(!db.HaveCoin(added_spent));
+    BOOST_CHECK(buffer.GetBestBlock() == block2);
+}
+
 BOOST_AUTO_TEST_CASE(coins_resource_is_used)
 {
     CCoinsMapMemoryResource resource;
@@ -139,6 +139,18 @@ void MinerTestingSetup::TestPackageSelection(const CScript& scriptPubKey, const
     BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashHighFeeTx);
     BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == hashMediumFeeTx);
 
+    // A selection made ahead of time gives the same block while the tip is unchanged
+    const auto block_txs = AssemblerForTest(tx_mempool).SelectBlockTransactions(GetAdjustedTimeSeconds());
+    BOOST_CHECK_EQUAL(block_txs->mempool_sequence, tx_mempool.GetSequence());
+    BOOST_REQUIRE_EQUAL(block_txs->vtx.size(), 3U);
+    auto reused_template = AssemblerForTest(tx_mempool).CreateNewBlock(scriptPubKey, nullptr, nullptr, nullptr, CNoDestination(), nullptr, block_txs.get());
+    BOOST_REQUIRE_EQUAL(reused_template->block.vtx.size(), 4U);
+    for (size_t i = 1; i < 4; ++i) {
+        BOOST_CHECK(reused_template->block.vtx[i]->GetHash() == pblocktemplate->block.vtx[i]->GetHash());
+        BOOST_CHECK_EQUAL(reused_template->vTxFees[i], pblocktemplate->vTxFees[i]);
+    }
+    BOOST_CHECK_EQUAL(reused_template->vTxFees[0], pblocktemplate->vTxFees[0]);
+
     // Test that a package below the block min tx fee doesn't get included
     tx.vin[0].prevout.hash = hashHighFeeTx;
     tx.vout[0].nValue = 5000000000LL - 1000 - 50000; // 0 fee
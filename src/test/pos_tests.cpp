@@ -0,0 +1,351 @@
+// Copyright (c) 2014-2024 The Blackcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <kernel/chain.h>
+#include <key.h>
+#include <node/stake_search.h>
+#include <node/stake_seen.h>
+#include <node/stake_stats.h>
+#include <node/stake_weight.h>
+#include <pos.h>
+#include <primitives/transaction.h>
+#include <script/interpreter.h>
+#include <test/util/random.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pos_tests, BasicTestingSetup)
+
+/* The prepared kernel must give the same result as the consensus kernel check */
+BOOST_AUTO_TEST_CASE(prepared_stake_kernel)
+{
+    CBlockIndex index;
+    index.nStakeModifier = InsecureRand256();
+
+    for (const unsigned int nBits : {0x1d00ffffU, 0x1c00ffffU, 0x1b0fffffU}) {
+        std::vector<CStakeKernel> kernels;
+        std::vector<bool> expected;
+        const uint32_t nTimeTx = 1700000000;
+        for (int i = 0; i < 1000; i++) {
+            const COutPoint prevout(InsecureRand256(), InsecureRandRange(8));
+            const uint32_t blockFromTime = nTimeTx - InsecureRandRange(86400);
+            const CAmount amount = 1 + InsecureRandRange(10000 * COIN);
+
+            CStakeKernel kernel;
+            BOOST_CHECK(PrepareStakeKernel(index.nStakeModifier, nBits, blockFromTime, amount, prevout, kernel));
+            const bool hit = CheckStakeKernelHash(&index, nBits, blockFromTime, amount, prevout, nTimeTx);
+            BOOST_CHECK_EQUAL(CheckStakeKernelHash(kernel, nTimeTx), hit);
+            // Timestamps before the coin time never meet the target
+            BOOST_CHECK(!CheckStakeKernelHash(kernel, blockFromTime - 1));
+
+            kernels.push_back(kernel);
+            expected.push_back(hit);
+        }
+
+        std::vector<size_t> hits;
+        CheckStakeKernelHashBatch(kernels, nTimeTx, hits);
+        size_t expected_hits = 0;
+        for (size_t i = 0; i < expected.size(); i++) {
+            if (expected[i]) {
+                BOOST_REQUIRE(expected_hits < hits.size());
+                BOOST_CHECK_EQUAL(hits[expected_hits++], i);
+            }
+        }
+        BOOST_CHECK_EQUAL(hits.size(), expected_hits);
+    }
+
+    // A zero value coin can not stake
+    CStakeKernel kernel;
+    BOOST_CHECK(!PrepareStakeKernel(index.nStakeModifier, 0x1d00ffff, 0, 0, COutPoint(InsecureRand256(), 0), kernel));
+}
+
+/* The kernel input signature is only checked if asked for */
+BOOST_AUTO_TEST_CASE(proof_of_stake_signature)
+{
+    const int nMaturity = Params().GetConsensus().nCoinbaseMaturity;
+    std::vector<CBlockIndex> chain(nMaturity + 1);
+    for (size_t i = 0; i < chain.size(); i++) {
+        chain[i].nHeight = i;
+        chain[i].pprev = i > 0 ? &chain[i - 1] : nullptr;
+        chain[i].nTime = 1700000000 + i * 64;
+        chain[i].nStakeModifier = InsecureRand256();
+    }
+
+    // A coin of the first block paying to a key, staked on top of the last one at a time it meets the target
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script{GetScriptForRawPubKey(key.GetPubKey())};
+    const COutPoint prevout(InsecureRand256(), 0);
+    CCoinsView base;
+    CCoinsViewCache view(&base);
+    view.AddCoin(prevout, Coin(CTxOut(1000 * COIN, script), 0, /*fCoinBaseIn=*/false, /*fCoinStakeIn=*/false, chain[0].nTime), false);
+
+    const unsigned int nBits = 0x1c00ffff;
+    CMutableTransaction tx;
+    tx.nTime = chain.back().nTime + 64;
+    while (!CheckStakeKernelHash(&chain.back(), nBits, chain[0].nTime, 1000 * COIN, prevout, tx.nTime)) tx.nTime += 16;
+    tx.vin.emplace_back(prevout);
+    tx.vout.emplace_back(0, CScript());
+    tx.vout.emplace_back(1000 * COIN, script);
+
+    BlockValidationState state;
+    BOOST_CHECK(!CheckProofOfStake(&chain.back(), CTransaction(tx), nBits, state, view, tx.nTime));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "stake-verify-signature-failed");
+    state = BlockValidationState{};
+    BOOST_CHECK(CheckProofOfStake(&chain.back(), CTransaction(tx), nBits, state, view, tx.nTime, /*fCheckSignature=*/false));
+
+    // The kernel is still checked without the signature
+    state = BlockValidationState{};
+    BOOST_CHECK(!CheckProofOfStake(&chain.back(), CTransaction(tx), 0x1800ffff, state, view, tx.nTime, /*fCheckSignature=*/false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "stake-check-kernel-failed");
+
+    std::vector<unsigned char> vchSig;
+    BOOST_REQUIRE(key.Sign(SignatureHash(script, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    for (const bool fCheckSignature : {true, false}) {
+        state = BlockValidationState{};
+        BOOST_CHECK(CheckProofOfStake(&chain.back(), CTransaction(tx), nBits, state, view, tx.nTime, fCheckSignature));
+    }
+}
+
+/* The search threads find the same kernels as a serial search, whatever the number of threads */
+BOOST_AUTO_TEST_CASE(stake_search_pool)
+{
+    const uint256 nStakeModifier = InsecureRand256();
+    const uint32_t nTimeFrom = 1700000000;
+    const uint32_t nSlotSpacing = 16;
+    const unsigned int nSlots = 4;
+
+    std::vector<std::vector<CStakeKernel>> wallets(3);
+    for (const size_t size : {node::STAKE_SEARCH_CHUNK_SIZE * 3 + 100, size_t{50}}) {
+        std::vector<CStakeKernel>& kernels = wallets[size > 50 ? 0 : 1];
+        kernels.resize(size);
+        for (CStakeKernel& kernel : kernels) {
+            const COutPoint prevout(InsecureRand256(), InsecureRandRange(8));
+            BOOST_CHECK(PrepareStakeKernel(nStakeModifier, 0x1d00ffff, nTimeFrom - InsecureRandRange(86400), 1 + InsecureRandRange(10000 * COIN), prevout, kernel));
+        }
+    }
+
+    std::vector<std::map<uint32_t, std::vector<size_t>>> expected(wallets.size());
+    for (size_t i = 0; i < wallets.size(); ++i) {
+        for (unsigned int slot = 0; slot < nSlots; ++slot) {
+            std::vector<size_t> hits;
+            CheckStakeKernelHashBatch(wallets[i], nTimeFrom + slot * nSlotSpacing, hits);
+            if (!hits.empty()) expected[i][nTimeFrom + slot * nSlotSpacing] = hits;
+        }
+    }
+    BOOST_REQUIRE(!expected[0].empty());
+
+    const auto make_jobs = [&] {
+        std::vector<node::StakeSearchJob> jobs;
+        for (const auto& kernels : wallets) {
+            jobs.push_back({&kernels, nTimeFrom, nSlots, {}});
+        }
+        return jobs;
+    };
+    for (const int threads : {1, 4}) {
+        node::StakeSearchPool pool(threads);
+        BOOST_CHECK_EQUAL(pool.Threads(), size_t(threads));
+        std::atomic<bool> interrupt{false};
+
+        // Twice, the pool is reused from one search to the next
+        for (int round = 0; round < 2; ++round) {
+            std::vector<node::StakeSearchJob> jobs{make_jobs()};
+            BOOST_CHECK(pool.Search(jobs, nSlotSpacing, /*stop_on_first_hit=*/false, interrupt));
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                BOOST_CHECK(jobs[i].hits == expected[i]);
+            }
+        }
+
+        uint64_t kernels{0}, chunks{0};
+        for (const node::StakeSearchStats& stats : pool.GetStats()) {
+            kernels += stats.kernels;
+            chunks += stats.chunks;
+            BOOST_CHECK(stats.stolen <= stats.chunks);
+        }
+        BOOST_CHECK_EQUAL(kernels, 2 * nSlots * (wallets[0].size() + wallets[1].size()));
+        BOOST_CHECK_EQUAL(chunks, 2 * 5);
+
+        // Stopping on the first kernel only returns kernels of the serial search
+        std::vector<node::StakeSearchJob> jobs{make_jobs()};
+        if (!pool.Search(jobs, nSlotSpacing, /*stop_on_first_hit=*/true, interrupt)) {
+            BOOST_CHECK(jobs[0].hits.count(nTimeFrom) || jobs[1].hits.count(nTimeFrom));
+        }
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            for (const auto& [nTime, hits] : jobs[i].hits) {
+                for (const size_t hit : hits) {
+                    BOOST_CHECK(std::count(expected[i][nTime].begin(), expected[i][nTime].end(), hit));
+                }
+            }
+        }
+
+        // Stopping on a hit in the last chunk still evaluates every kernel
+        const auto& [nTimeHit, hits]{*expected[0].begin()};
+        const std::vector<CStakeKernel> hit_kernel{wallets[0][hits.front()]};
+        jobs = {{&hit_kernel, nTimeHit, 1, {}}};
+        BOOST_CHECK(pool.Search(jobs, nSlotSpacing, /*stop_on_first_hit=*/true, interrupt));
+        BOOST_CHECK(jobs[0].hits[nTimeHit] == std::vector<size_t>{0});
+
+        // A cancelled search evaluates nothing
+        interrupt = true;
+        jobs = make_jobs();
+        BOOST_CHECK(!pool.Search(jobs, nSlotSpacing, /*stop_on_first_hit=*/false, interrupt));
+        for (const node::StakeSearchJob& job : jobs) {
+            BOOST_CHECK(job.hits.empty());
+        }
+    }
+}
+
+/* Staking latencies land in the power of two bucket above them */
+BOOST_AUTO_TEST_CASE(stake_latency_histogram)
+{
+    node::LatencyHistogram histogram;
+    for (const int64_t us : {0, 1, 2, 3, 4, 1000, 1023, 1024}) {
+        histogram.Add(std::chrono::microseconds{us});
+    }
+    // Longer than the last bucket limit, and negative from a clock adjustment
+    histogram.Add(std::chrono::hours{1});
+    histogram.Add(std::chrono::microseconds{-5});
+
+    const auto& buckets = histogram.Buckets();
+    BOOST_CHECK_EQUAL(buckets[0], 2U);
+    BOOST_CHECK_EQUAL(buckets[1], 1U);
+    BOOST_CHECK_EQUAL(buckets[2], 2U);
+    BOOST_CHECK_EQUAL(buckets[3], 1U);
+    BOOST_CHECK_EQUAL(buckets[10], 2U);
+    BOOST_CHECK_EQUAL(buckets[11], 1U);
+    BOOST_CHECK_EQUAL(buckets[node::LatencyHistogram::BUCKETS - 1], 1U);
+    BOOST_CHECK_EQUAL(histogram.Count(), 10U);
+    BOOST_CHECK(histogram.Max() == std::chrono::hours{1});
+    BOOST_CHECK(histogram.Total() == std::chrono::hours{1} + std::chrono::microseconds{3057});
+    for (size_t i = 0; i + 1 < node::LatencyHistogram::BUCKETS; ++i) {
+        BOOST_CHECK(node::LatencyHistogram::BucketLimit(i) == std::chrono::microseconds{int64_t{1} << i});
+    }
+    BOOST_CHECK_EQUAL(node::StakeStageName(node::StakeStage::KERNEL_SEARCH), "kernel_search");
+}
+
+/* A stake seen in one block is a duplicate in any other block, and the index stays bounded */
+BOOST_AUTO_TEST_CASE(stake_seen_index)
+{
+    node::StakeSeenIndex index{/*max_stakes=*/100};
+
+    const COutPoint prevout(InsecureRand256(), 1);
+    const uint32_t nTime = 1700000000;
+    const uint256 first{InsecureRand256()};
+    const uint256 second{InsecureRand256()};
+
+    BOOST_CHECK(!index.IsDuplicate(prevout, nTime, first));
+    index.Add(prevout, nTime, first);
+    BOOST_CHECK(!index.IsDuplicate(prevout, nTime, first));
+    BOOST_CHECK(index.IsDuplicate(prevout, nTime, second));
+    BOOST_CHECK(!index.IsDuplicate(prevout, nTime + 16, second));
+    BOOST_CHECK(!index.IsDuplicate(COutPoint(prevout.hash, 2), nTime, second));
+
+    // Adding the stake again keeps the first block
+    index.Add(prevout, nTime, second);
+    BOOST_CHECK(index.IsDuplicate(prevout, nTime, second));
+    BOOST_CHECK_EQUAL(index.Size(), 1U);
+
+    // The oldest stakes are dropped once the index is full
+    for (int i = 0; i < 100; i++) {
+        index.Add(COutPoint(InsecureRand256(), 0), nTime, InsecureRand256());
+    }
+    BOOST_CHECK_EQUAL(index.Size(), 100U);
+    BOOST_CHECK(!index.IsDuplicate(prevout, nTime, second));
+}
+
+BOOST_AUTO_TEST_CASE(last_block_index_links)
+{
+    // Runs of proof-of-work and proof-of-stake blocks of random length
+    std::vector<CBlockIndex> linked(2000), walked(2000);
+    for (size_t i = 0; i < linked.size(); i++) {
+        const bool fProofOfStake = i > 0 && (InsecureRandRange(8) == 0 ? !linked[i - 1].IsProofOfStake() : linked[i - 1].IsProofOfStake());
+        for (auto* chain : {&linked, &walked}) {
+            CBlockIndex& index = (*chain)[i];
+            index.nHeight = i;
+            index.pprev = i > 0 ? &(*chain)[i - 1] : nullptr;
+            if (fProofOfStake) index.SetProofOfStake();
+        }
+        linked[i].BuildPrevOtherType();
+    }
+
+    BOOST_CHECK(linked[0].pprevOtherType == nullptr);
+    for (size_t i = 0; i < linked.size(); i++) {
+        for (const bool fProofOfStake : {false, true}) {
+            // Entries without the link walk pprev like before
+            const CBlockIndex* expected = GetLastBlockIndex(&walked[i], fProofOfStake);
+            BOOST_CHECK_EQUAL(GetLastBlockIndex(&linked[i], fProofOfStake)->nHeight, expected->nHeight);
+        }
+        if (i > 0) {
+            BOOST_CHECK_EQUAL(linked[i].pprevOtherType->nHeight, GetLastBlockIndex(&walked[i - 1], !linked[i].IsProofOfStake())->nHeight);
+        }
+    }
+}
+
+//! Walk of the original GetPoSKernelPS over the last nPoSInterval stakes
+static double WalkKernelsPS(const CBlockIndex* pindex, int nPoSInterval)
+{
+    double dStakeKernelsTriedAvg = 0;
+    int nStakesHandled = 0, nStakesTime = 0;
+    const CBlockIndex* pindexPrevStake = nullptr;
+    while (pindex && nStakesHandled < nPoSInterval) {
+        if (pindex->IsProofOfStake()) {
+            if (pindexPrevStake) {
+                dStakeKernelsTriedAvg += GetDifficulty(pindexPrevStake) * 4294967296.0;
+                nStakesTime += pindexPrevStake->nTime - pindex->nTime;
+                nStakesHandled++;
+            }
+            pindexPrevStake = pindex;
+        }
+        pindex = pindex->pprev;
+    }
+    return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime * 16 : 0;
+}
+
+BOOST_AUTO_TEST_CASE(stake_weight_estimator)
+{
+    std::vector<CBlockIndex> chain(400);
+    for (size_t i = 0; i < chain.size(); i++) {
+        CBlockIndex& index = chain[i];
+        index.nHeight = i;
+        index.pprev = i > 0 ? &chain[i - 1] : nullptr;
+        index.nTime = 1700000000 + 64 * i + InsecureRandRange(64);
+        index.nBits = 0x1c000000 | (0x1000 + InsecureRandRange(0xf000));
+        if (i > 0 && InsecureRandRange(4) != 0) index.SetProofOfStake();
+        index.BuildPrevOtherType();
+    }
+    const auto check = [&](const node::StakeWeightEstimator& estimator, size_t tip, size_t window) {
+        const double expected = WalkKernelsPS(&chain[tip], window);
+        BOOST_CHECK_CLOSE(estimator.GetKernelsPS(window), expected, 1e-6);
+    };
+
+    node::StakeWeightEstimator estimator(0xf, {10, 50});
+    BOOST_CHECK(estimator.GetWindows() == std::vector<size_t>({10, 50}));
+    BOOST_CHECK_EQUAL(estimator.GetKernelsPS(10), 0);
+    estimator.Init(&chain[200]);
+    BOOST_CHECK_EQUAL(estimator.Size(), 50U);
+    for (const size_t window : {1, 10, 25, 50}) check(estimator, 200, window);
+
+    for (size_t i = 201; i < 300; i++) {
+        estimator.BlockConnected(ChainstateRole::NORMAL, nullptr, &chain[i]);
+        check(estimator, i, 10);
+        check(estimator, i, 50);
+    }
+    // Disconnected blocks bring back the older entries of the smaller window
+    for (size_t i = 299; i > 280; i--) {
+        estimator.BlockDisconnected(nullptr, &chain[i]);
+        check(estimator, i - 1, 10);
+    }
+    // A fresh estimator gives the same results
+    node::StakeWeightEstimator reloaded(0xf, {10, 50});
+    reloaded.Init(&chain[280]);
+    BOOST_CHECK_CLOSE(reloaded.GetKernelsPS(10), estimator.GetKernelsPS(10), 1e-6);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,8 @@
 #include <boost/test/unit_test.hpp>
 
 #include <crypto/scrypt.h>
+#include <primitives/block.h>
+#include <streams.h>
 #include <uint256.h>
 #include <util/strencodings.h>
 
@@ -31,4 +33,65 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_multi_hashtest)
+{
+    // Enough inputs to run every multi-lane implementation and the scalar tail
+    const char* inputhex[] = { "020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659", "0200000011503ee6a855e900c00cfdd98f5f55fffeaee9b6bf55bea9b852d9de2ce35828e204eef76acfd36949ae56d1fbe81c1ac9c0209e6331ad56414f9072506a77f8c6faf551eac7471b00389d01", "02000000a72c8a177f523946f42f22c3e86b8023221b4105e8007e59e81f6beb013e29aaf635295cb9ac966213fb56e046dc71df5b3f7f67ceaeab24038e743f883aff1aaafaf551eac7471b0166249b", "010000007824bc3a8a1b4628485eee3024abd8626721f7f870f8ad4d2f33a27155167f6a4009d1285049603888fe85a84b6c803a53305a8d497965a5e896e1a00568359589faf551eac7471b0065434e", "0200000050bfd4e4a307a8cb6ef4aef69abc5c0f2d579648bd80d7733e1ccc3fbc90ed664a7f74006cb11bde87785f229ecd366c2d4e44432832580e0608c579e4cb76f383f7f551eac7471b00c36982" };
+    const char* expected[] = { "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806" , "00000000003a0d11bdd5eb634e08b7feddcfbbf228ed35d250daf19f1c88fc94", "00000000000b40f895f288e13244728a6c2d9d59d8aff29c65f8dd5114a8ca81", "00000000003007005891cd4923031e99d8e8d72f6e8e7edc6a86181897e105fe", "000000000018f0b426a4afc7130ccb47fa02af730d345b4fe7c7724d3800ec8c" };
+    const size_t count = 16 + 8 + 5;
+
+    BOOST_TEST_MESSAGE("Using the '" << ScryptAutoDetect() << "' scrypt implementation");
+    std::vector<unsigned char> input;
+    for (size_t i = 0; i < count; i++) {
+        const std::vector<unsigned char> bytes = ParseHex(inputhex[i % 5]);
+        input.insert(input.end(), bytes.begin(), bytes.end());
+    }
+    std::vector<unsigned char> output(count * 32);
+    scrypt_1024_1_1_256_multi((const char*)input.data(), (char*)output.data(), count);
+    for (size_t i = 0; i < count; i++) {
+        BOOST_CHECK_EQUAL(uint256(Span{output}.subspan(i * 32, 32)).ToString(), expected[i % 5]);
+    }
+
+    // Batch hashing fills the header hash cache
+    std::vector<CBlockHeader> headers(5);
+    std::vector<const CBlockHeader*> pheaders;
+    for (size_t i = 0; i < 5; i++) {
+        CDataStream{ParseHex(inputhex[i]), SER_NETWORK} >> headers[i];
+        ++headers[i].nTime; // not hashed before
+        pheaders.push_back(&headers[i]);
+    }
+    CachePoWHashes(pheaders);
+    uint256 scrypthash;
+    for (const CBlockHeader& header : headers) {
+        scrypt_1024_1_1_256(BEGIN(header.nVersion), BEGIN(scrypthash));
+        BOOST_CHECK_EQUAL(header.GetPoWHash().ToString(), scrypthash.ToString());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_header_hash_cache)
+{
+    // Scrypt-era header (nVersion 2) from the vectors above
+    CBlockHeader header;
+    CDataStream{ParseHex("020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659"), SER_NETWORK} >> header;
+    const std::string expected{"00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806"};
+
+    // Cached and uncached lookups, on the header and on a copy, agree
+    BOOST_CHECK_EQUAL(header.GetPoWHash().ToString(), expected);
+    BOOST_CHECK_EQUAL(header.GetPoWHash().ToString(), expected);
+    BOOST_CHECK_EQUAL(header.GetHash().ToString(), expected);
+    CBlock block{header};
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), expected);
+
+    // Changing the header never returns the cached hash of the old one
+    uint256 scrypthash;
+    for (uint32_t i = 0; i < 4; ++i) {
+        ++header.nNonce;
+        scrypt_1024_1_1_256(BEGIN(header.nVersion), BEGIN(scrypthash));
+        BOOST_CHECK_EQUAL(header.GetHash().ToString(), scrypthash.ToString());
+        BOOST_CHECK(header.GetHash().ToString() != expected);
+    }
+    header.nNonce -= 4;
+    BOOST_CHECK_EQUAL(header.GetHash().ToString(), expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
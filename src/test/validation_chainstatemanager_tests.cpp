@@ -256,6 +256,11 @@ struct SnapshotTestSetup : TestChain100Setup {
                 // Wrong hash
                 metadata.m_base_blockhash = uint256::ONE;
         }));
+        BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
+            this, [](AutoFile& auto_infile, SnapshotMetadata& metadata) {
+                // Stake modifier does not match the assumeutxo data
+                metadata.m_stake_modifier = uint256::ONE;
+        }));
 
         BOOST_REQUIRE(CreateAndActivateUTXOSnapshot(this));
         BOOST_CHECK(fs::exists(*node::FindSnapshotChainstateDir(chainman.m_options.datadir)));
@@ -775,4 +780,67 @@ BOOST_FIXTURE_TEST_CASE(chainstatemanager_snapshot_completion_hash_mismatch, Sna
     }
 }
 
+//! A background chainstate computing another stake modifier for the snapshot
+//! base block than the snapshot came with invalidates the snapshot.
+BOOST_FIXTURE_TEST_CASE(chainstatemanager_snapshot_completion_stake_modifier_mismatch, SnapshotTestSetup)
+{
+    auto chainstates = this->SetupSnapshot();
+    Chainstate& validation_chainstate = *std::get<0>(chainstates);
+    ChainstateManager& chainman = *Assert(m_node.chainman);
+    m_node.notifications->m_shutdown_on_fatal_error = false;
+
+    // Rewind the background chainstate below the base block, and tamper with
+    // the stake modifier the snapshot set on it.
+    DisconnectedBlockTransactions unused_pool{MAX_DISCONNECTED_TX_POOL_SIZE * 1000};
+    BlockValidationState state;
+    {
+        LOCK2(::cs_main, validation_chainstate.MempoolMutex());
+        BOOST_CHECK(validation_chainstate.DisconnectTip(state, &unused_pool));
+        unused_pool.clear();  // to avoid queuedTx assertion errors on teardown
+        CBlockIndex* base{Assert(chainman.m_blockman.LookupBlockIndex(*chainman.SnapshotBlockhash()))};
+        base->nStakeModifier = uint256::ONE;
+        validation_chainstate.setBlockIndexCandidates.insert(base);
+    }
+    BOOST_CHECK_EQUAL(WITH_LOCK(::cs_main, return validation_chainstate.m_chain.Height()), 109);
+
+    fs::path snapshot_chainstate_dir = gArgs.GetDataDirNet() / "chainstate_snapshot";
+    BOOST_CHECK(fs::exists(snapshot_chainstate_dir));
+
+    // Connecting the base block again completes the snapshot validation
+    {
+        ASSERT_DEBUG_LOG("does not match the one computed by the background chainstate");
+        validation_chainstate.ActivateBestChain(state);
+    }
+
+    auto all_chainstates = chainman.GetAll();
+    BOOST_CHECK_EQUAL(all_chainstates.size(), 1);
+    BOOST_CHECK_EQUAL(all_chainstates[0], &validation_chainstate);
+    BOOST_CHECK_EQUAL(&chainman.ActiveChainstate(), &validation_chainstate);
+    BOOST_CHECK(fs::exists(gArgs.GetDataDirNet() / "chainstate_snapshot_INVALID"));
+}
+
+//! The stake modifier of a snapshot is not covered by the UTXO set hash, so it
+//! has to match the one of the assumeutxo parameters.
+BOOST_FIXTURE_TEST_CASE(chainstatemanager_snapshot_stake_modifier, BasicTestingSetup)
+{
+    const uint256 stake_modifier{InsecureRand256()};
+    AssumeutxoData au_data{
+        .height = 110,
+        .hash_serialized = AssumeutxoHash{uint256::ONE},
+        .nChainTx = 1,
+        .blockhash = uint256::ONE,
+        .stake_modifier = uint256{},
+    };
+    {
+        ASSERT_DEBUG_LOG("has no stake modifier");
+        BOOST_CHECK(!CheckSnapshotStakeModifier(stake_modifier, au_data));
+    }
+    au_data.stake_modifier = stake_modifier;
+    BOOST_CHECK(CheckSnapshotStakeModifier(stake_modifier, au_data));
+    {
+        ASSERT_DEBUG_LOG("bad snapshot stake modifier");
+        BOOST_CHECK(!CheckSnapshotStakeModifier(uint256::ONE, au_data));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,15 +8,18 @@
 #include <coins.h>
 #include <dbwrapper.h>
 #include <logging.h>
+#include <memusage.h>
 #include <primitives/transaction.h>
 #include <random.h>
 #include <serialize.h>
 #include <uint256.h>
+#include <util/threadnames.h>
 #include <util/vector.h>
 
 #include <cassert>
 #include <cstdlib>
 #include <iterator>
+#include <stdexcept>
 #include <utility>
 
 static constexpr uint8_t DB_COIN{'C'};
@@ -149,6 +152,140 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, boo
     return ret;
 }
 
+CCoinsViewFlushBuffer::CCoinsViewFlushBuffer(CCoinsView* db)
+    : CCoinsViewBacked(db),
+      m_pending{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &m_pending_memory_resource},
+      m_thread{[this] { ThreadWrite(); }}
+{
+}
+
+CCoinsViewFlushBuffer::~CCoinsViewFlushBuffer()
+{
+    WITH_LOCK(m_mutex, m_stop = true);
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void CCoinsViewFlushBuffer::ThreadWrite()
+{
+    util::ThreadRename("coinsflush");
+    WAIT_LOCK(m_mutex, lock);
+    while (true) {
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || m_writing; });
+        // Stop only once the coins handed over are written
+        if (!m_writing) return;
+        const uint256 hashBlock{m_pending_block};
+        bool ok{false};
+        {
+            REVERSE_LOCK(lock);
+            try {
+                ok = base->BatchWrite(m_pending, hashBlock, /*erase=*/false);
+            } catch (const std::runtime_error& e) {
+                LogPrintLevel(BCLog::COINDB, BCLog::Level::Error, "Failed to write coins in the background: %s\n", e.what());
+            }
+        }
+        if (ok) {
+            ReleasePending();
+        } else {
+            m_write_failed = true;
+        }
+        m_writing = false;
+        m_cv.notify_all();
+    }
+}
+
+void CCoinsViewFlushBuffer::ReleasePending()
+{
+    m_pending_block.SetNull();
+    m_pending_usage = 0;
+    m_pending.~CCoinsMap();
+    m_pending_memory_resource.~CCoinsMapMemoryResource();
+    ::new (&m_pending_memory_resource) CCoinsMapMemoryResource{};
+    ::new (&m_pending) CCoinsMap{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &m_pending_memory_resource};
+}
+
+bool CCoinsViewFlushBuffer::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        LOCK(m_mutex);
+        if (auto it{m_pending.find(outpoint)}; it != m_pending.end()) {
+            if (it->second.coin.IsSpent()) return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    // Coins not handed over are not being written, so the database is up to date for them
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewFlushBuffer::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        LOCK(m_mutex);
+        if (auto it{m_pending.find(outpoint)}; it != m_pending.end()) {
+            return !it->second.coin.IsSpent();
+        }
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewFlushBuffer::GetBestBlock() const
+{
+    {
+        LOCK(m_mutex);
+        if (!m_pending_block.IsNull()) return m_pending_block;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlushBuffer::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase)
+{
+    if (!Wait()) return false;
+    {
+        LOCK(m_mutex);
+        // The previous write ended, so nothing is pending and the database is
+        // the parent of the coins handed over.
+        assert(m_pending.empty());
+        for (auto it{mapCoins.begin()}; it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+            // A fresh coin is not in the database, nor is it once spent
+            if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent()) continue;
+            CCoinsCacheEntry& entry{m_pending[it->first]};
+            entry.coin = erase ? std::move(it->second.coin) : it->second.coin;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            m_pending_usage += entry.coin.DynamicMemoryUsage();
+        }
+        m_pending_usage += memusage::DynamicUsage(m_pending);
+        m_pending_block = hashBlock;
+        m_writing = true;
+    }
+    m_cv.notify_all();
+    return true;
+}
+
+std::unique_ptr<CCoinsViewCursor> CCoinsViewFlushBuffer::Cursor() const
+{
+    Wait();
+    return base->Cursor();
+}
+
+bool CCoinsViewFlushBuffer::Wait() const
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_writing; });
+    return !m_write_failed;
+}
+
+bool CCoinsViewFlushBuffer::WriteFailed() const
+{
+    return WITH_LOCK(m_mutex, return m_write_failed);
+}
+
+size_t CCoinsViewFlushBuffer::DynamicMemoryUsage() const
+{
+    return WITH_LOCK(m_mutex, return m_pending_usage);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return m_db->EstimateSize(DB_COIN, uint8_t(DB_COIN + 1));
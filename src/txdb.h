@@ -12,10 +12,12 @@
 #include <sync.h>
 #include <util/fs.h>
 
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <thread>
 #include <vector>
 
 class COutPoint;
@@ -77,4 +79,65 @@ public:
     std::optional<fs::path> StoragePath() { return m_db->StoragePath(); }
 };
 
+/**
+ * CCoinsView between the coins cache and the coin database that writes the
+ * cache to the database on a background thread. A flush of the cache hands
+ * its dirty coins over to this view and returns at once, and the coins are
+ * served from here until they are written, so that validation goes on with
+ * an empty cache instead of waiting on the database. The coins being written
+ * count against the coins cache size, so that the cache and this view
+ * together stay within -dbcache.
+ *
+ * One write is in flight at a time: a flush arriving during a write waits for
+ * it to end. A crash during a write leaves the head blocks of the partial
+ * write in the database, from which blocks are replayed at startup as after
+ * a crash during a foreground flush. A failed write is not retried: its coins
+ * are kept and served from here, and the next flush of the chainstate shuts
+ * the node down.
+ */
+class CCoinsViewFlushBuffer final : public CCoinsViewBacked
+{
+private:
+    mutable Mutex m_mutex;
+    mutable std::condition_variable m_cv;
+    //! Coins handed over by the last flush, all dirty. Modified with m_mutex
+    //! held while no write is in flight, read by the writer thread without it.
+    CCoinsMapMemoryResource m_pending_memory_resource{};
+    CCoinsMap m_pending;
+    //! Best block of the handed over coins, null once written
+    uint256 m_pending_block GUARDED_BY(m_mutex);
+    //! Memory used by m_pending
+    size_t m_pending_usage GUARDED_BY(m_mutex){0};
+    bool m_writing GUARDED_BY(m_mutex){false};
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+
+    void ThreadWrite() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    void ReleasePending() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+public:
+    explicit CCoinsViewFlushBuffer(CCoinsView* db);
+    //! Finishes a write in flight
+    ~CCoinsViewFlushBuffer();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    bool HaveCoin(const COutPoint& outpoint) const override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    uint256 GetBestBlock() const override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    //! Hands the dirty coins over to the writer thread, after the previous write ended
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    std::unique_ptr<CCoinsViewCursor> Cursor() const override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /**
+     * Wait for a write in flight to end, for the database to hold all the coins handed over.
+     *
+     * @returns false if a write failed, the coins not written are then kept
+     */
+    bool Wait() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    //! Whether a write failed, without waiting
+    bool WriteFailed() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    //! Memory used by the coins handed over and not written yet
+    size_t DynamicMemoryUsage() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+};
+
 #endif // BITCOIN_TXDB_H
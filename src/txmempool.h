@@ -41,8 +41,9 @@
 
 class CChain;
 
-/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
-static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
+/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8),
+ *  the largest height a Coin holds */
+static const uint32_t MEMPOOL_HEIGHT = 0x3FFFFFFF;
 
 /**
  * Test whether the LockPoints height and time are still valid on the current chain
@@ -73,6 +73,7 @@
 #include <optional>
 #include <string>
 #include <tuple>
+#include <unordered_set>
 #include <utility>
 
 using kernel::CCoinsStats;
@@ -1667,7 +1668,8 @@ CAmount GetProofOfStakeSubsidy()
 
 CoinsViews::CoinsViews(DBParams db_params, CoinsViewOptions options)
     : m_dbview{std::move(db_params), std::move(options)},
-      m_catcherview(&m_dbview) {}
+      m_flushview(&m_dbview),
+      m_catcherview(&m_flushview) {}
 
 void CoinsViews::InitCache()
 {
@@ -2063,14 +2065,87 @@ DisconnectResult Chainstate::DisconnectBlock(const CBlock& block, const CBlockIn
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
+/**
+ * Closure representing the read of one coin spent by a block from the coins
+ * database or the coins being written to it, into a slot of its own so that
+ * reads can run in parallel.
+ */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsView* m_db;
+    const COutPoint* m_outpoint;
+    std::optional<Coin>* m_coin;
+
+public:
+    CCoinsPrefetch(const CCoinsView& db, const COutPoint& outpoint, std::optional<Coin>& coin) :
+        m_db(&db), m_outpoint(&outpoint), m_coin(&coin) { }
+
+    bool operator()()
+    {
+        try {
+            Coin coin;
+            if (m_db->GetCoin(*m_outpoint, coin)) *m_coin = std::move(coin);
+            return true;
+        } catch (const std::runtime_error&) {
+            // Left to the lookup of ConnectBlock, which reports the error
+            return false;
+        }
+    }
+};
+
+static CCheckQueue<CCoinsPrefetch> coinprefetchqueue(128, "coinfetch");
+
 void StartScriptCheckWorkerThreads(int threads_num)
 {
     scriptcheckqueue.StartWorkerThreads(threads_num);
+    coinprefetchqueue.StartWorkerThreads(threads_num);
 }
 
 void StopScriptCheckWorkerThreads()
 {
     scriptcheckqueue.StopWorkerThreads();
+    coinprefetchqueue.StopWorkerThreads();
+}
+
+size_t Chainstate::PrefetchInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!coinprefetchqueue.HasThreads()) return 0;
+    CCoinsViewCache& cache{CoinsTip()};
+
+    // Coins created by the block itself are not in the database yet
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> outpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!block_txids.count(txin.prevout.hash) && !cache.HaveCoinInCache(txin.prevout)) {
+                outpoints.push_back(txin.prevout);
+            }
+        }
+    }
+    if (outpoints.size() < MIN_PREFETCH_INPUTS) return 0;
+
+    std::vector<std::optional<Coin>> coins(outpoints.size());
+    std::vector<CCoinsPrefetch> reads;
+    reads.reserve(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        reads.emplace_back(CoinsFlushBuffer(), outpoints[i], coins[i]);
+    }
+    CCheckQueueControl<CCoinsPrefetch> control(&coinprefetchqueue);
+    control.Add(std::move(reads));
+    if (!control.Wait()) return 0;
+
+    // Only outpoints missing from the cache were read, for which the database is
+    // up to date, and the cache is not modified by anything else under cs_main.
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (coins[i]) cache.AddFetchedCoin(outpoints[i], std::move(*coins[i]));
+    }
+    return outpoints.size();
 }
 
 /**
@@ -2206,12 +2281,6 @@ bool Chainstate::ConnectBlock(const CBlock& block, BlockValidationState& state,
     uint256 hashPrevBlock = pindex->pprev == nullptr ? uint256() : pindex->pprev->GetBlockHash();
     assert(hashPrevBlock == view.GetBestBlock());
 
-    // Check proof-of-stake
-    if (block.IsProofOfStake() && params.GetConsensus().IsProtocolV3(block.GetBlockTime()) && !CheckProofOfStake(pindex->pprev, *block.vtx[1], block.nBits, state, view, block.vtx[1]->nTime ? block.vtx[1]->nTime : block.nTime)) {
-        LogPrintf("WARNING: %s: check proof-of-stake failed for block %s\n", __func__, block.GetHash().ToString());
-        return false; // do not error here as we expect this during initial block download
-    }
-
     num_blocks_total++;
 
     // Special case for the genesis block, skipping connection of its transactions
@@ -2253,6 +2322,13 @@ bool Chainstate::ConnectBlock(const CBlock& block, BlockValidationState& state,
         }
     }
 
+    // Check proof-of-stake. The signature of the kernel input is checked unless the
+    // scripts of the block are skipped under assumevalid.
+    if (block.IsProofOfStake() && params.GetConsensus().IsProtocolV3(block.GetBlockTime()) && !CheckProofOfStake(pindex->pprev, *block.vtx[1], block.nBits, state, view, block.vtx[1]->nTime ? block.vtx[1]->nTime : block.nTime, /*fCheckSignature=*/fScriptChecks)) {
+        LogPrintf("WARNING: %s: check proof-of-stake failed for block %s\n", __func__, block.GetHash().ToString());
+        return false; // do not error here as we expect this during initial block download
+    }
+
     const auto time_1{SteadyClock::now()};
     time_check += time_1 - time_start;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n",
@@ -2411,7 +2487,14 @@ bool Chainstate::ConnectBlock(const CBlock& block, BlockValidationState& state,
              Ticks<MillisecondsDouble>(time_verify) / num_blocks_total);
 
     // Set proof-of-stake hash modifier
-    pindex->nStakeModifier = ComputeStakeModifier(pindex->pprev, block.IsProofOfStake() ? block.vtx[1]->vin[0].prevout.hash : block.GetHash());
+    const uint256 nStakeModifier{ComputeStakeModifier(pindex->pprev, block.IsProofOfStake() ? block.vtx[1]->vin[0].prevout.hash : block.GetHash())};
+    if (pindex == m_chainman.GetSnapshotBaseBlock() && pindex->nStakeModifier != nStakeModifier) {
+        // The snapshot chainstate checked the kernels after its base with the modifier of the snapshot
+        LogPrintf("[snapshot] stake modifier %s of the snapshot base block does not match the computed %s\n",
+            pindex->nStakeModifier.ToString(), nStakeModifier.ToString());
+        m_snapshot_stake_modifier_mismatch = true;
+    }
+    pindex->nStakeModifier = nStakeModifier;
 
     if (fJustCheck)
         return true;
@@ -2432,6 +2515,14 @@ bool Chainstate::ConnectBlock(const CBlock& block, BlockValidationState& state,
         m_blockman.m_dirty_blockindex.insert(pindex);
     }
 
+    // Remember the stake only now that the kernel and the signature of its input have
+    // been checked, so that nobody but its owner can make us reject a block using it.
+    COutPoint stake_prevout;
+    uint32_t stake_time{0};
+    if (node::StakeSeenIndex::GetStake(block, stake_prevout, stake_time)) {
+        m_chainman.m_stake_seen.Add(stake_prevout, stake_time, pindex->GetBlockHash());
+    }
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2468,7 +2559,8 @@ CoinsCacheSizeState Chainstate::GetCoinsCacheSizeState(
 {
     AssertLockHeld(::cs_main);
     const int64_t nMempoolUsage = m_mempool ? m_mempool->DynamicMemoryUsage() : 0;
-    int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
+    // The coins still being written to the database take their share of the cache
+    int64_t cacheSize = CoinsTip().DynamicMemoryUsage() + CoinsFlushBuffer().DynamicMemoryUsage();
     int64_t nTotalSpace =
         max_coins_cache_size_bytes + std::max<int64_t>(int64_t(max_mempool_size_bytes) - nMempoolUsage, 0);
 
@@ -2563,7 +2655,8 @@ bool Chainstate::FlushStateToDisk(
             if (!CheckDiskSpace(m_chainman.m_options.datadir, 48 * 2 * 2 * CoinsTip().GetCacheSize())) {
                 return FatalError(m_chainman.GetNotifications(), state, "Disk space is too low!", _("Disk space is too low!"));
             }
-            // Flush the chainstate (which may refer to block index entries).
+            // Flush the chainstate (which may refer to block index entries),
+            // written to disk in the background.
             if (!CoinsTip().Flush())
                 return FatalError(m_chainman.GetNotifications(), state, "Failed to write to coin database");
             m_last_flush = nNow;
@@ -2574,6 +2667,16 @@ bool Chainstate::FlushStateToDisk(
                    (uint64_t)coins_count,
                    (uint64_t)coins_mem_usage);
         }
+        // A forced flush returns with the coins on disk, as callers read the
+        // database or reopen it next. A failed background write is fatal, its
+        // coins are only kept in memory. Block files are never pruned, so the
+        // blocks of a write in flight stay on disk to be replayed after a crash.
+        if (mode == FlushStateMode::ALWAYS || CoinsFlushBuffer().WriteFailed()) {
+            LOG_TIME_MILLIS_WITH_CATEGORY("wait for coins database write", BCLog::BENCH);
+            if (!CoinsFlushBuffer().Wait()) {
+                return FatalError(m_chainman.GetNotifications(), state, "Failed to write to coin database");
+            }
+        }
     }
     if (full_flush_completed) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -2821,6 +2924,11 @@ bool Chainstate::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew,
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms\n",
              Ticks<MillisecondsDouble>(time_2 - time_1));
     {
+        const size_t prefetched{PrefetchInputs(blockConnecting)};
+        if (prefetched) {
+            LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms (%u coins)\n",
+                     Ticks<MillisecondsDouble>(SteadyClock::now() - time_2), prefetched);
+        }
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view);
         GetMainSignals().BlockChecked(blockConnecting, state);
@@ -3527,7 +3635,7 @@ void ChainstateManager::ReceivedBlockTransactions(const CBlock& block, CBlockInd
     }
 }
 
-static bool CheckBlockSignature(const CBlock& block)
+bool CheckBlockSignature(const CBlock& block)
 {
     if (block.IsProofOfWork())
         return block.vchBlockSig.empty();
@@ -4128,10 +4236,20 @@ bool ChainstateManager::AcceptBlockHeader(const CBlockHeader& block, BlockValida
 bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, bool min_pow_checked, BlockValidationState& state, bool old_client, const CBlockIndex** ppindex,  const CBlockIndex** pindexFirst)
 {
     AssertLockNotHeld(cs_main);
+
+    // Hash every header that AcceptBlockHeader will scrypt (the legacy block hash, or the
+    // proof-of-work check) in one multi-lane batch before taking cs_main.
+    std::vector<const CBlockHeader*> pow_headers;
+    for (const CBlockHeader& header : headers) {
+        if (header.nVersion <= 6 || !(header.nFlags & CBlockIndex::BLOCK_PROOF_OF_STAKE)) {
+            pow_headers.push_back(&header);
+        }
+    }
+    CachePoWHashes(pow_headers);
+
     {
         LOCK(cs_main);
         bool bFirst = true;
-        bool fInstantBan = false;
         for (size_t i = 0; i < headers.size(); ++i) {
             const CBlockHeader& header = headers[i];
 
@@ -4140,10 +4258,6 @@ bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>&
             CheckBlockIndex();
 
             if (!accepted) {
-                // if we have seen a duplicate stake in this header list previously, then ban immediately
-                if (fInstantBan) {
-                    state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, state.GetRejectReason(), "instant ban, due to duplicate header in the chain");
-                }
                 return false;
             }
             if (ppindex) {
@@ -4242,6 +4356,19 @@ bool ChainstateManager::AcceptBlock(const std::shared_ptr<const CBlock>& pblock,
         if (pindex->nChainWork < MinimumChainWork()) return true;
     }
 
+    // Blackcoin: a stake can only be used once per chain. Reject blocks reusing the stake
+    // of a block we have already connected before checking them any further, unless they
+    // are on the best header chain. The block is not marked invalid, so it can still be
+    // fetched and connected if its chain becomes the best one.
+    COutPoint stake_prevout;
+    uint32_t stake_time{0};
+    if (node::StakeSeenIndex::GetStake(block, stake_prevout, stake_time) &&
+        m_stake_seen.IsDuplicate(stake_prevout, stake_time, pindex->GetBlockHash()) &&
+        !(m_best_header && m_best_header->GetAncestor(pindex->nHeight) == pindex)) {
+        return state.Invalid(BlockValidationResult::BLOCK_DUPLICATE_STAKE, "bad-cs-duplicate",
+                             strprintf("duplicate proof-of-stake (%s, %d) for block %s", stake_prevout.ToString(), stake_time, pindex->GetBlockHash().ToString()));
+    }
+
     const CChainParams& params{GetParams()};
 
     if (!CheckBlock(block, state, params.GetConsensus(), ActiveChainstate()) ||
@@ -4712,7 +4839,11 @@ bool ChainstateManager::LoadBlockIndex()
     // Load block index from databases
     bool needs_init = fReindex;
     if (!fReindex) {
-        bool ret{m_blockman.LoadBlockIndexDB(SnapshotBlockhash())};
+        // The block index snapshot is only used if written at the best block of
+        // the active chainstate's coins database, when that is already open
+        Chainstate& active{ActiveChainstate()};
+        const uint256 best_block{active.m_coins_views ? active.CoinsDB().GetBestBlock() : uint256{}};
+        bool ret{m_blockman.LoadBlockIndexDB(SnapshotBlockhash(), best_block)};
         if (!ret) return false;
 
         std::vector<CBlockIndex*> vSortedByHeight{m_blockman.GetAllBlockIndices()};
@@ -5231,6 +5362,8 @@ bool Chainstate::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
+    // The database is reopened, no write to it may be in flight
+    CoinsFlushBuffer().Wait();
     CoinsDB().ResizeCache(coinsdb_size);
 
     LogPrintf("[%s] resized coinsdb cache to %.1f MiB\n",
@@ -5495,6 +5628,21 @@ static void SnapshotUTXOHashBreakpoint(const util::SignalInterrupt& interrupt)
     if (interrupt) throw StopHashingException();
 }
 
+bool CheckSnapshotStakeModifier(const uint256& stake_modifier, const AssumeutxoData& au_data)
+{
+    // Unlike the coins, the stake modifier is not covered by hash_serialized
+    if (au_data.stake_modifier.IsNull()) {
+        LogPrintf("[snapshot] assumeutxo data at height %d has no stake modifier - refusing to load snapshot\n", au_data.height);
+        return false;
+    }
+    if (stake_modifier != au_data.stake_modifier) {
+        LogPrintf("[snapshot] bad snapshot stake modifier: expected %s, got %s\n",
+            au_data.stake_modifier.ToString(), stake_modifier.ToString());
+        return false;
+    }
+    return true;
+}
+
 bool ChainstateManager::PopulateAndValidateSnapshot(
     Chainstate& snapshot_chainstate,
     AutoFile& coins_file,
@@ -5527,6 +5675,10 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
 
     const AssumeutxoData& au_data = *maybe_au_data;
 
+    if (!CheckSnapshotStakeModifier(metadata.m_stake_modifier, au_data)) {
+        return false;
+    }
+
     // This work comparison is a duplicate check with the one performed later in
     // ActivateSnapshot(), but is done so that we avoid doing the long work of staging
     // a snapshot that isn't actually usable.
@@ -5634,6 +5786,10 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
     // As above, okay to immediately release cs_main here since no other context knows
     // about the snapshot_chainstate.
     CCoinsViewDB* snapshot_coinsdb = WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
+    if (!WITH_LOCK(::cs_main, return snapshot_chainstate.CoinsFlushBuffer().Wait())) {
+        LogPrintf("[snapshot] failed to write the snapshot coins\n");
+        return false;
+    }
 
     std::optional<CCoinsStats> maybe_stats;
 
@@ -5703,6 +5859,13 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
 
     assert(index);
     index->nChainTx = au_data.nChainTx;
+
+    // Set the stake modifier ConnectBlock would have computed, so that the block
+    // after the base can be connected. The background chainstate checks it when
+    // it gets there.
+    snapshot_start_block->nStakeModifier = metadata.m_stake_modifier;
+    m_blockman.m_dirty_blockindex.insert(snapshot_start_block);
+
     snapshot_chainstate.setBlockIndexCandidates.insert(snapshot_start_block);
 
     LogPrintf("[snapshot] validated snapshot (%.2f MB)\n",
@@ -5789,6 +5952,14 @@ SnapshotCompletionResult ChainstateManager::MaybeCompleteSnapshotValidation()
 
     assert(index_new.nHeight == snapshot_base_height);
 
+    if (m_ibd_chainstate->m_snapshot_stake_modifier_mismatch) {
+        LogPrintf("[snapshot] stake modifier of the snapshot base block %s does not match "
+          "the one computed by the background chainstate. Snapshot is not valid.\n",
+          snapshot_blockhash.ToString());
+        handle_invalid_snapshot();
+        return SnapshotCompletionResult::STAKE_MODIFIER_MISMATCH;
+    }
+
     int curr_height = m_ibd_chainstate->m_chain.Height();
 
     assert(snapshot_base_height == curr_height);
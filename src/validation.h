@@ -23,6 +23,7 @@
 #include <kernel/chainstatemanager_opts.h>
 #include <kernel/cs_main.h> // IWYU pragma: export
 #include <node/blockstorage.h>
+#include <node/stake_seen.h>
 #include <policy/feerate.h>
 #include <policy/packages.h>
 #include <policy/policy.h>
@@ -82,6 +83,8 @@ static const unsigned int TX_FEE_PER_KB = 100000;
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Fewer inputs of a block missing from the coins cache are read by ConnectBlock itself */
+static constexpr size_t MIN_PREFETCH_INPUTS{4};
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ActiveChain().Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 static const signed int DEFAULT_CHECKBLOCKS = 6;
@@ -359,6 +362,8 @@ static_assert(std::is_nothrow_destructible_v<CScriptCheck>);
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, Chainstate& chainstate, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
 bool CheckCanonicalBlockSignature(const std::shared_ptr<const CBlock>& pblock);
+/** Check the signature of a proof-of-stake block by the key of its coinstake, proof-of-work blocks have none */
+bool CheckBlockSignature(const CBlock& block);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block) */
 bool TestBlockValidity(BlockValidationState& state,
@@ -437,6 +442,10 @@ public:
     //! All unspent coins reside in this store.
     CCoinsViewDB m_dbview GUARDED_BY(cs_main);
 
+    //! This view holds the coins flushed from the cache while they are written to
+    //! the leveldb database in the background.
+    CCoinsViewFlushBuffer m_flushview GUARDED_BY(cs_main);
+
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
 
@@ -444,7 +453,7 @@ public:
     //! can fit per the dbcache setting.
     std::unique_ptr<CCoinsViewCache> m_cacheview GUARDED_BY(cs_main);
 
-    //! This constructor initializes CCoinsViewDB and CCoinsViewErrorCatcher instances, but it
+    //! This constructor initializes CCoinsViewDB, CCoinsViewFlushBuffer and CCoinsViewErrorCatcher instances, but it
     //! *does not* create a CCoinsViewCache instance by default. This is done separately because the
     //! presence of the cache has implications on whether or not we're allowed to flush the cache's
     //! state to disk, which should not be done until the health of the database is verified.
@@ -512,6 +521,10 @@ protected:
     //! Cached result of LookupBlockIndex(*m_from_snapshot_blockhash)
     const CBlockIndex* m_cached_snapshot_base GUARDED_BY(::cs_main) {nullptr};
 
+    //! Set on the background validation chainstate when the stake modifier it
+    //! computes for the snapshot base block differs from the snapshot's.
+    bool m_snapshot_stake_modifier_mismatch GUARDED_BY(::cs_main) {false};
+
 public:
     //! Reference to a BlockManager instance which itself is shared across all
     //! Chainstate instances.
@@ -599,6 +612,14 @@ public:
         return Assert(m_coins_views)->m_dbview;
     }
 
+    //! @returns A reference to the view of the coins being written to the
+    //!     on-disk UTXO set database in the background.
+    CCoinsViewFlushBuffer& CoinsFlushBuffer() EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
+    {
+        AssertLockHeld(::cs_main);
+        return Assert(m_coins_views)->m_flushview;
+    }
+
     //! @returns A pointer to the mempool.
     CTxMemPool* GetMempool()
     {
@@ -676,6 +697,15 @@ public:
         EXCLUSIVE_LOCKS_REQUIRED(!m_chainstate_mutex)
         LOCKS_EXCLUDED(::cs_main);
 
+    /**
+     * Read the coins spent by a block that are missing from the coins cache
+     * in parallel on the script check threads, and add them to the cache so
+     * that ConnectBlock does not wait on one database read per input.
+     *
+     * @returns the number of coins looked up, zero if nothing was prefetched
+     */
+    size_t PrefetchInputs(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
     // Block (dis)connection on a given view:
     DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
         EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
@@ -804,8 +834,18 @@ enum class SnapshotCompletionResult {
     // The blockhash of the current tip of the background validation chainstate does
     // not match the one expected by the snapshot chainstate.
     BASE_BLOCKHASH_MISMATCH,
+
+    // The stake modifier computed by the background validation chainstate for the
+    // base block does not match the one the snapshot came with.
+    STAKE_MODIFIER_MISMATCH,
 };
 
+/**
+ * Check the stake modifier of the base block a snapshot came with against the
+ * one of the assumeutxo parameters, which is required.
+ */
+bool CheckSnapshotStakeModifier(const uint256& stake_modifier, const AssumeutxoData& au_data);
+
 /**
  * Provides an interface for creating and interacting with one or two
  * chainstates: an IBD chainstate generated by downloading blocks, and
@@ -1004,6 +1044,10 @@ public:
     /** Best header we've seen so far (used for getheaders queries' starting points). */
     CBlockIndex* m_best_header GUARDED_BY(::cs_main){nullptr};
 
+    /** Stakes of recently connected proof-of-stake blocks, used to reject blocks
+     *  reusing a stake before their proof-of-stake and transactions are checked. */
+    node::StakeSeenIndex m_stake_seen GUARDED_BY(::cs_main);
+
     //! The total number of bytes available for us to use across all in-memory
     //! coins caches. This will be split somehow across chainstates.
     int64_t m_total_coinstip_cache{0};
@@ -11,8 +11,12 @@
 #include <wallet/wallet.h>
 #include <node/context.h>
 #include <node/miner.h>
+#include <node/stake_stats.h>
+#include <node/stake_weight.h>
+#include <chain.h> // For GetDifficulty
 #include <key_io.h> // For EncodeDestination
 #include <pow.h> // For GetNextTargetRequired
+#include <util/string.h>
 #include <warnings.h>
 
 #include <univalue.h>
@@ -37,6 +41,10 @@ static RPCHelpMan getstakinginfo()
                         {RPCResult::Type::NUM, "search-interval", "The staker search interval"},
                         {RPCResult::Type::NUM, "weight", "The staker weight"},
                         {RPCResult::Type::NUM, "netstakeweight", "Network stake weight"},
+                        {RPCResult::Type::OBJ_DYN, "netstakeweights", "Network stake weight over the last proof-of-stake blocks of each -stakeweightwindow",
+                        {
+                            {RPCResult::Type::NUM, "blocks", "Network stake weight over the last blocks"},
+                        }},
                         {RPCResult::Type::NUM, "expectedtime", "Expected time to earn reward"},
                     }
                 },
@@ -59,6 +67,12 @@ static RPCHelpMan getstakinginfo()
         lastCoinStakeSearchInterval = pwallet->m_enabled_staking ? pwallet->m_last_coin_stake_search_interval : 0;
     }
 
+    UniValue netstakeweights(UniValue::VOBJ);
+    for (const size_t window : pwallet->chain().getPoSKernelPSWindows()) {
+        netstakeweights.pushKV(ToString(window), (uint64_t)(1.1429 * pwallet->chain().getPoSKernelPS(window)));
+    }
+    uint64_t nNetworkWeight = 1.1429 * pwallet->chain().getPoSKernelPS(node::DEFAULT_STAKE_WEIGHT_WINDOW);
+
     const CTxMemPool& mempool = pwallet->chain().mempool();
     ChainstateManager& chainman = pwallet->chain().chainman();
     LOCK(cs_main);
@@ -66,7 +80,6 @@ static RPCHelpMan getstakinginfo()
 
     UniValue obj(UniValue::VOBJ);
 
-    uint64_t nNetworkWeight = 1.1429 * GetPoSKernelPS(chainman);
     bool staking = lastCoinStakeSearchInterval && nWeight;
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -86,6 +99,7 @@ static RPCHelpMan getstakinginfo()
     obj.pushKV("search-interval", (int)lastCoinStakeSearchInterval);
     obj.pushKV("weight", (uint64_t)nWeight);
     obj.pushKV("netstakeweight", (uint64_t)nNetworkWeight);
+    obj.pushKV("netstakeweights", netstakeweights);
     obj.pushKV("expectedtime", nExpectedTime);
 
     obj.pushKV("chain", chainman.GetParams().GetChainTypeString());
@@ -95,6 +109,121 @@ static RPCHelpMan getstakinginfo()
     };
 }
 
+static UniValue LatencyHistogramToJSON(const node::LatencyHistogram& histogram)
+{
+    UniValue buckets(UniValue::VARR);
+    for (size_t i = 0; i < histogram.Buckets().size(); ++i) {
+        if (!histogram.Buckets()[i]) continue;
+        UniValue bucket(UniValue::VOBJ);
+        if (i + 1 < histogram.Buckets().size()) {
+            bucket.pushKV("below_us", count_microseconds(node::LatencyHistogram::BucketLimit(i)));
+        }
+        bucket.pushKV("count", histogram.Buckets()[i]);
+        buckets.push_back(bucket);
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("count", histogram.Count());
+    obj.pushKV("mean_us", histogram.Count() ? count_microseconds(histogram.Total()) / (int64_t)histogram.Count() : 0);
+    obj.pushKV("max_us", count_microseconds(histogram.Max()));
+    obj.pushKV("buckets", buckets);
+    return obj;
+}
+
+static RPCHelpMan getstakingstats()
+{
+    const std::vector<RPCResult> histogram{
+        {RPCResult::Type::NUM, "count", "Number of measurements"},
+        {RPCResult::Type::NUM, "mean_us", "Mean latency in microseconds"},
+        {RPCResult::Type::NUM, "max_us", "Maximum latency in microseconds"},
+        {RPCResult::Type::ARR, "buckets", "Non-empty buckets, in power of two microseconds",
+        {
+            {RPCResult::Type::OBJ, "", "",
+            {
+                {RPCResult::Type::NUM, "below_us", /*optional=*/true, "Latencies counted are less than this, omitted for the last bucket counting any longer latency"},
+                {RPCResult::Type::NUM, "count", "Number of latencies in the bucket"},
+            }},
+        }},
+    };
+    return RPCHelpMan{"getstakingstats",
+                "\nReturns latencies and counters of the node's staking thread since startup, shared by all the staking wallets.",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "rounds", "Rounds that searched a timestamp slot"},
+                        {RPCResult::Type::NUM, "slots_searched", "Timestamp slots searched"},
+                        {RPCResult::Type::NUM, "slots_missed", "Timestamp slots that passed without being searched while staking"},
+                        {RPCResult::Type::NUM, "kernels_evaluated", "Kernels hashed, one per coin and slot"},
+                        {RPCResult::Type::NUM, "kernels_per_second", "Kernels hashed per second of kernel search"},
+                        {RPCResult::Type::NUM, "kernels_found", "Coins meeting the target in the slot searched"},
+                        {RPCResult::Type::NUM, "stale_templates", "Blocks dropped because the tip changed while they were built"},
+                        {RPCResult::Type::NUM, "blocks_staked", "Staked blocks accepted by the node"},
+                        {RPCResult::Type::NUM, "blocks_rejected", "Staked blocks not accepted by the node"},
+                        {RPCResult::Type::NUM, "blocks_orphaned", "Accepted staked blocks that left the active chain"},
+                        {RPCResult::Type::NUM, "blocks_confirmed", strprintf("Accepted staked blocks %d blocks deep in the active chain", node::STAKE_CONFIRM_DEPTH)},
+                        {RPCResult::Type::OBJ, "latency", "Latency histograms",
+                        {
+                            {RPCResult::Type::OBJ, "round", "Rounds, from the snapshots of the wallets to the block", histogram},
+                            {RPCResult::Type::OBJ, "snapshot", "Taking the stake candidates of a wallet", histogram},
+                            {RPCResult::Type::OBJ, "kernel_search", "Hashing the kernels of the look-ahead slots", histogram},
+                            {RPCResult::Type::OBJ, "template", "Selecting the transactions and creating the coinstake and block", histogram},
+                            {RPCResult::Type::OBJ, "sign", "Signing the block", histogram},
+                            {RPCResult::Type::OBJ, "process_block", "Checking and connecting the block", histogram},
+                        }},
+                        {RPCResult::Type::ARR, "search_threads", "Kernel search threads, empty when not staking",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::NUM, "kernels", "Kernels hashed"},
+                                {RPCResult::Type::NUM, "chunks", "Chunks of kernels evaluated"},
+                                {RPCResult::Type::NUM, "stolen", "Chunks taken from another thread"},
+                                {RPCResult::Type::NUM, "busy_ms", "Time spent hashing in milliseconds"},
+                            }},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getstakingstats", "")
+            + HelpExampleRpc("getstakingstats", "")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const node::StakeMinerStats stats{node::GetStakeMinerStats()};
+
+    UniValue latency(UniValue::VOBJ);
+    latency.pushKV("round", LatencyHistogramToJSON(stats.round));
+    for (size_t i = 0; i < node::STAKE_STAGE_COUNT; ++i) {
+        latency.pushKV(node::StakeStageName(static_cast<node::StakeStage>(i)), LatencyHistogramToJSON(stats.stages[i]));
+    }
+    UniValue search_threads(UniValue::VARR);
+    for (const node::StakeSearchStats& thread : stats.search_threads) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("kernels", thread.kernels);
+        obj.pushKV("chunks", thread.chunks);
+        obj.pushKV("stolen", thread.stolen);
+        obj.pushKV("busy_ms", Ticks<std::chrono::milliseconds>(thread.busy));
+        search_threads.push_back(obj);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("rounds", stats.rounds);
+    obj.pushKV("slots_searched", stats.slots_searched);
+    obj.pushKV("slots_missed", stats.slots_missed);
+    obj.pushKV("kernels_evaluated", stats.kernels_evaluated);
+    obj.pushKV("kernels_per_second", stats.kernel_search_time.count() ? stats.kernels_evaluated / Ticks<SecondsDouble>(stats.kernel_search_time) : 0.0);
+    obj.pushKV("kernels_found", stats.kernels_found);
+    obj.pushKV("stale_templates", stats.stale_templates);
+    obj.pushKV("blocks_staked", stats.blocks_staked);
+    obj.pushKV("blocks_rejected", stats.blocks_rejected);
+    obj.pushKV("blocks_orphaned", stats.blocks_orphaned);
+    obj.pushKV("blocks_confirmed", stats.blocks_confirmed);
+    obj.pushKV("latency", latency);
+    obj.pushKV("search_threads", search_threads);
+    return obj;
+},
+    };
+}
+
 static RPCHelpMan staking()
 {
     return RPCHelpMan{"staking",
@@ -367,6 +496,7 @@ static const CRPCCommand commands[] =
 { //  category              actor (function)
   //  ------------------    ------------------------
     { "staking",            &getstakinginfo,                 },
+    { "staking",            &getstakingstats,                },
     { "staking",            &reservebalance,                 },
     { "staking",            &staking,                        },
     { "staking",            &checkkernel,                    },
@@ -642,6 +642,12 @@ SigningResult DescriptorScriptPubKeyMan::SignBlockHash(const uint256 &hash, cons
     return SigningResult::OK;
 }
 
+bool DescriptorScriptPubKeyMan::GetStakingKey(const CScript& script, const CKeyID& keyid, CKey& key) const
+{
+    std::unique_ptr<FlatSigningProvider> keys = GetSigningProvider(script, true);
+    return keys && keys->GetKey(keyid, key);
+}
+
 TransactionError LegacyScriptPubKeyMan::FillPSBT(PartiallySignedTransaction& psbtx, const PrecomputedTransactionData& txdata, int sighash_type, bool sign, bool bip32derivs, int* n_signed, bool finalize) const
 {
     if (n_signed) {
@@ -5,7 +5,8 @@
 // Staking start/stop algos by Qtum
 // Copyright (c) 2016-2023 The Qtum developers
 
-#include <index/txindex.h>
+#include <pow.h>
+#include <script/interpreter.h>
 #include <wallet/coincontrol.h>
 #include <wallet/receive.h>
 #include <wallet/staking.h>
@@ -17,7 +18,7 @@ static int64_t GetStakeCombineThreshold() { return 500 * COIN; }
 static int64_t GetStakeSplitThreshold() { return 2 * GetStakeCombineThreshold(); }
 
 void StakeCoins(CWallet& wallet, bool fStake) {
-    node::StakeCoins(fStake, &wallet, wallet.threadStakeMinerGroup);
+    node::StakeCoins(fStake, &wallet);
 }
 
 void StartStake(CWallet& wallet) {
@@ -40,17 +41,10 @@ void StartStake(CWallet& wallet) {
 }
 
 void StopStake(CWallet& wallet) {
-    if (!wallet.threadStakeMinerGroup) {
-        if (wallet.m_enabled_staking)
-            wallet.m_enabled_staking = false;
-    }
-    else {
-        wallet.m_stop_staking_thread = true;
-        wallet.m_enabled_staking = false;
-        StakeCoins(wallet, false);
-        wallet.threadStakeMinerGroup = 0;
-        wallet.m_stop_staking_thread = false;
-    }
+    wallet.m_stop_staking_thread = true;
+    wallet.m_enabled_staking = false;
+    StakeCoins(wallet, false);
+    wallet.m_stop_staking_thread = false;
 }
 
 uint64_t GetStakeWeight(const CWallet& wallet)
@@ -104,100 +98,81 @@ void AvailableCoinsForStaking(const CWallet& wallet,
     const bool only_safe = true;
 
     std::set<uint256> trusted_parents;
-    for (const auto& entry : wallet.mapWallet)
+    // Outputs are ordered by txid, so the transaction checks run once per transaction
+    const CWalletTx* last_wtx = nullptr;
+    bool last_wtx_ok = false;
+    for (const auto& [outpoint, stakeable] : wallet.GetStakeableOutputs())
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx& wtx = entry.second;
-
-        if (wallet.IsTxImmature(wtx))
-            continue;
-
-        int nDepth = wallet.GetTxDepthInMainChain(wtx);
-        if (nDepth < 0)
-            continue;
-
-        // We should not consider coins which aren't at least in our mempool
-        // It's possible for these to be conflicted via ancestors which we may never be able to detect
-        if (nDepth == 0 && !wtx.InMempool())
-            continue;
-
-        bool safeTx = CachedTxIsTrusted(wallet, wtx, trusted_parents);
-
-        if (only_safe && !safeTx) {
-            continue;
-        }
-
-        if (nDepth < min_depth || nDepth > max_depth) {
-            continue;
-        }
+        const CWalletTx& wtx = *stakeable.wtx;
 
-        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
-            const CTxOut& output = wtx.tx->vout[i];
-            const COutPoint outpoint(wtxid, i);
+        if (&wtx != last_wtx) {
+            last_wtx = &wtx;
+            last_wtx_ok = false;
 
-            if (output.nValue < wallet.m_min_staking_amount)
+            if (wallet.IsTxImmature(wtx))
                 continue;
 
-            if (output.nValue < params.min_amount || output.nValue > params.max_amount)
+            int nDepth = wallet.GetTxDepthInMainChain(wtx);
+            if (nDepth < 0)
                 continue;
 
-            if (wallet.IsLockedCoin(outpoint) && params.skip_locked)
+            // We should not consider coins which aren't at least in our mempool
+            // It's possible for these to be conflicted via ancestors which we may never be able to detect
+            if (nDepth == 0 && !wtx.InMempool())
                 continue;
 
-            if (wallet.IsSpent(outpoint))
-                continue;
-
-            isminetype mine = wallet.IsMine(output);
+            bool safeTx = CachedTxIsTrusted(wallet, wtx, trusted_parents);
 
-            if (mine == ISMINE_NO) {
+            if (only_safe && !safeTx) {
                 continue;
             }
 
-            if (!allow_used_addresses && wallet.IsSpentKey(output.scriptPubKey)) {
+            if (nDepth < min_depth || nDepth > max_depth) {
                 continue;
             }
 
-            std::unique_ptr<SigningProvider> provider = wallet.GetSolvingProvider(output.scriptPubKey);
+            last_wtx_ok = true;
+        }
+        if (!last_wtx_ok)
+            continue;
 
-            bool solvable = provider ? InferDescriptor(output.scriptPubKey, *provider)->IsSolvable() : false;
-            bool spendable = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (((mine & ISMINE_WATCH_ONLY) != ISMINE_NO) && (coinControl && coinControl->fAllowWatchOnly && solvable));
+        const CTxOut& output = wtx.tx->vout[outpoint.n];
 
-            // Filter by spendable outputs only
-            if (!spendable && params.only_spendable) continue;
+        if (output.nValue < wallet.m_min_staking_amount)
+            continue;
 
-            // If the Output is P2SH and spendable, we want to know if it is
-            // a P2SH (legacy) or one of P2SH-P2WPKH, P2SH-P2WSH (P2SH-Segwit). We can determine
-            // this from the redeemScript. If the Output is not spendable, it will be classified
-            // as a P2SH (legacy), since we have no way of knowing otherwise without the redeemScript
-            CScript script;
-            if (output.scriptPubKey.IsPayToScriptHash() && solvable) {
-                CTxDestination destination;
-                if (!ExtractDestination(output.scriptPubKey, destination))
-                    continue;
-                const CScriptID& hash = ToScriptID(std::get<ScriptHash>(destination));
-                if (!provider->GetCScript(hash, script))
-                    continue;
-            } else {
-                script = output.scriptPubKey;
-            }
+        if (output.nValue < params.min_amount || output.nValue > params.max_amount)
+            continue;
 
-            if (spendable)
-                vCoins.push_back(std::make_pair(&wtx, i));
+        if (wallet.IsLockedCoin(outpoint) && params.skip_locked)
+            continue;
 
-            // Cache total amount as we go
-            nTotal += output.nValue;
-            // Checks the sum amount of all UTXO's.
-            if (params.min_sum_amount != MAX_MONEY) {
-                if (nTotal >= params.min_sum_amount) {
-                    return;
-                }
-            }
+        if (!allow_used_addresses && wallet.IsSpentKey(output.scriptPubKey)) {
+            continue;
+        }
+
+        const isminetype mine = stakeable.mine;
+        bool spendable = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (((mine & ISMINE_WATCH_ONLY) != ISMINE_NO) && (coinControl && coinControl->fAllowWatchOnly && stakeable.solvable));
+
+        // Filter by spendable outputs only
+        if (!spendable && params.only_spendable) continue;
 
-            // Checks the maximum number of UTXO's.
-            if (params.max_count > 0 && vCoins.size() >= params.max_count) {
+        if (spendable)
+            vCoins.push_back(std::make_pair(&wtx, outpoint.n));
+
+        // Cache total amount as we go
+        nTotal += output.nValue;
+        // Checks the sum amount of all UTXO's.
+        if (params.min_sum_amount != MAX_MONEY) {
+            if (nTotal >= params.min_sum_amount) {
                 return;
             }
         }
+
+        // Checks the maximum number of UTXO's.
+        if (params.max_count > 0 && vCoins.size() >= params.max_count) {
+            return;
+        }
     }
 }
 
@@ -243,18 +218,253 @@ bool SelectCoinsForStaking(const CWallet& wallet, CAmount& nTargetValue, std::se
     return true;
 }
 
+// Kernel data of a wallet output, taken from the wallet transaction and the block index
+// so that neither the coins view nor a transaction index has to be consulted
+static std::optional<CStakeCache> GetStakeKernelData(const CWalletTx& wtx, unsigned int n, const CBlockIndex* pindexPrev)
+{
+    const TxStateConfirmed* conf = wtx.state<TxStateConfirmed>();
+    if (!conf)
+        return std::nullopt;
+
+    if (pindexPrev->nHeight + 1 - conf->confirmed_block_height < Params().GetConsensus().nCoinbaseMaturity)
+        return std::nullopt;
+
+    const CBlockIndex* blockFrom = pindexPrev->GetAncestor(conf->confirmed_block_height);
+    if (!blockFrom || blockFrom->GetBlockHash() != conf->confirmed_block_hash)
+        return std::nullopt;
+
+    return CStakeCache(wtx.tx->nTime ? wtx.tx->nTime : blockFrom->nTime, wtx.tx->vout[n].nValue);
+}
+
+const StakeSigningContext::Script* StakeSigningContext::FindScript(const CScript& script) const
+{
+    const auto it = scripts.find(script);
+    return it != scripts.end() && it->second ? &*it->second : nullptr;
+}
+
+const std::pair<CKey, CPubKey>* StakeSigningContext::FindKey(const CKeyID& keyid) const
+{
+    const auto it = keys.find(keyid);
+    return it != keys.end() ? &it->second : nullptr;
+}
+
+// Private key of a single key script, from the legacy keystore or its descriptor
+static bool AddStakeKey(const CWallet& wallet, const CScript& script, const CKeyID& keyid, StakeSigningContext& signing) EXCLUSIVE_LOCKS_REQUIRED(wallet.cs_wallet)
+{
+    if (signing.keys.count(keyid))
+        return true;
+    CKey key;
+    if (wallet.IsLegacy()) {
+        const LegacyScriptPubKeyMan* spk_man = wallet.GetLegacyScriptPubKeyMan();
+        if (!spk_man || !spk_man->GetKey(keyid, key))
+            return false;
+    } else {
+        const std::set<ScriptPubKeyMan*> spk_mans = wallet.GetScriptPubKeyMans(script);
+        if (std::none_of(spk_mans.begin(), spk_mans.end(), [&](const ScriptPubKeyMan* spk_man) { return spk_man->GetStakingKey(script, keyid, key); }))
+            return false;
+    }
+    signing.keys.emplace(keyid, std::make_pair(key, key.GetPubKey()));
+    return true;
+}
+
+// Keys and coinstake output of a kernel script, the same as CreateCoinStake
+// works out on its generic path. Taproot kernels are left to that path.
+static std::optional<StakeSigningContext::Script> PrepareStakeScript(const CWallet& wallet, const CScript& script, StakeSigningContext& signing) EXCLUSIVE_LOCKS_REQUIRED(wallet.cs_wallet)
+{
+    std::vector<std::vector<unsigned char>> vSolutions;
+    StakeSigningContext::Script prepared;
+    prepared.type = Solver(script, vSolutions);
+    if (prepared.type == TxoutType::PUBKEY)
+        prepared.keyid = CPubKey(vSolutions[0]).GetID();
+    else if (prepared.type == TxoutType::PUBKEYHASH || prepared.type == TxoutType::WITNESS_V0_KEYHASH)
+        prepared.keyid = CKeyID(uint160(vSolutions[0]));
+    else
+        return std::nullopt;
+    if (!AddStakeKey(wallet, script, prepared.keyid, signing))
+        return std::nullopt;
+
+    if (prepared.type == TxoutType::PUBKEY) {
+        prepared.scriptPubKeyOut = script;
+    } else if (prepared.type == TxoutType::PUBKEYHASH) {
+        prepared.scriptPubKeyOut << ToByteVector(signing.keys.at(prepared.keyid).second) << OP_CHECKSIG;
+    } else {
+        // Witness kernels pay to the key of the staking address, which signs the block
+        const PKHash* pkhash = std::get_if<PKHash>(&signing.dest);
+        if (!pkhash || !AddStakeKey(wallet, GetScriptForDestination(*pkhash), ToKeyID(*pkhash), signing))
+            return std::nullopt;
+        prepared.scriptPubKeyOut << ToByteVector(signing.keys.at(ToKeyID(*pkhash)).second) << OP_CHECKSIG;
+        prepared.fMinterKey = true;
+    }
+    return prepared;
+}
+
+bool SignStakeInputs(const CWallet& wallet, CMutableTransaction& tx, const std::vector<CTxOut>& spent_outputs, const StakeSigningContext& signing)
+{
+    // Locking the wallet takes cs_wallet, so it can not happen while signing
+    AssertLockHeld(wallet.cs_wallet);
+    if (wallet.IsLocked())
+        return false;
+
+    std::vector<const StakeSigningContext::Script*> scripts;
+    for (const CTxOut& txout : spent_outputs) {
+        const StakeSigningContext::Script* prepared = signing.FindScript(txout.scriptPubKey);
+        if (!prepared || !signing.FindKey(prepared->keyid))
+            return false;
+        scripts.push_back(prepared);
+    }
+
+    PrecomputedTransactionData txdata;
+    txdata.Init(tx, std::vector<CTxOut>{spent_outputs}, /*force=*/true);
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+        const auto& [key, pubkey] = *signing.FindKey(scripts[nIn]->keyid);
+        const bool fWitness = scripts[nIn]->type == TxoutType::WITNESS_V0_KEYHASH;
+        const CScript scriptCode = fWitness ? GetScriptForDestination(PKHash(pubkey)) : spent_outputs[nIn].scriptPubKey;
+        const uint256 hash = SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL, spent_outputs[nIn].nValue, fWitness ? SigVersion::WITNESS_V0 : SigVersion::BASE, &txdata);
+        std::vector<unsigned char> vchSig;
+        if (!key.Sign(hash, vchSig))
+            return false;
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+
+        CTxIn& txin = tx.vin[nIn];
+        txin.scriptSig.clear();
+        txin.scriptWitness.SetNull();
+        if (fWitness)
+            txin.scriptWitness.stack = {vchSig, ToByteVector(pubkey)};
+        else if (scripts[nIn]->type == TxoutType::PUBKEY)
+            txin.scriptSig << vchSig;
+        else
+            txin.scriptSig << vchSig << ToByteVector(pubkey);
+    }
+    return true;
+}
+
+bool CreateStakeSnapshot(CWallet& wallet, StakeSnapshot& snapshot, const CTxDestination& dest)
+{
+    snapshot.prevouts.clear();
+    snapshot.kernels.clear();
+    if (!(snapshot.signing.dest == dest)) {
+        snapshot.signing = StakeSigningContext{};
+        snapshot.signing.dest = dest;
+    }
+
+    const CBlockIndex* pindexPrev;
+    {
+        LOCK(cs_main);
+        pindexPrev = wallet.chain().getTip();
+        snapshot.hashPrevBlock = pindexPrev->GetBlockHash();
+        snapshot.nBits = GetNextTargetRequired(pindexPrev, Params().GetConsensus(), true);
+    }
+
+    // Collect the kernel data of the coins to stake with
+    std::vector<std::pair<COutPoint, CStakeCache> > vCoins;
+    {
+        LOCK(wallet.cs_wallet);
+        const auto bal = GetBalance(wallet);
+        CAmount nBalance = bal.m_mine_trusted;
+        if (wallet.IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS))
+            nBalance += bal.m_watchonly_trusted;
+
+        if (nBalance <= wallet.m_reserve_balance)
+            return false;
+
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoins;
+        CAmount nValueIn = 0;
+        CAmount nTargetValue = nBalance - wallet.m_reserve_balance;
+        if (!SelectCoinsForStaking(wallet, nTargetValue, setCoins, nValueIn))
+            return false;
+
+        // With -stakecache the kernel data is kept across staking rounds,
+        // otherwise it is rebuilt for this round
+        std::map<COutPoint, CStakeCache> roundCache;
+        std::map<COutPoint, CStakeCache>& stakeCache = wallet.m_use_stake_cache ? wallet.m_stake_cache : roundCache;
+        vCoins.reserve(setCoins.size());
+        for (const std::pair<const CWalletTx*, unsigned int> &pcoin : setCoins)
+        {
+            COutPoint prevout(pcoin.first->GetHash(), pcoin.second);
+            auto it = stakeCache.find(prevout);
+            if (it == stakeCache.end()) {
+                std::optional<CStakeCache> kernel = GetStakeKernelData(*pcoin.first, pcoin.second, pindexPrev);
+                if (!kernel)
+                    continue;
+                it = stakeCache.emplace(prevout, *kernel).first;
+            }
+            vCoins.emplace_back(prevout, it->second);
+
+            // The keys of a script are only looked up the first time one of its coins is staked with
+            const CScript& script = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
+            if (!snapshot.signing.scripts.count(script))
+                snapshot.signing.scripts.emplace(script, PrepareStakeScript(wallet, script, snapshot.signing));
+        }
+    }
+
+    // Prepare the kernel hashes without holding any lock
+    snapshot.prevouts.reserve(vCoins.size());
+    snapshot.kernels.reserve(vCoins.size());
+    for (const auto& [prevout, stake] : vCoins)
+    {
+        CStakeKernel kernel;
+        if (!PrepareStakeKernel(pindexPrev->nStakeModifier, snapshot.nBits, stake.blockFromTime, stake.amount, prevout, kernel))
+            continue;
+        snapshot.prevouts.push_back(prevout);
+        snapshot.kernels.push_back(kernel);
+    }
+
+    return !snapshot.kernels.empty();
+}
+
+bool FindStakeKernels(const StakeSnapshot& snapshot, uint32_t nTime, StakeKernelHits& hits)
+{
+    hits.hashPrevBlock = snapshot.hashPrevBlock;
+    hits.nTime = nTime;
+    hits.prevouts.clear();
+
+    std::vector<size_t> vHits;
+    CheckStakeKernelHashBatch(snapshot.kernels, nTime, vHits);
+    for (size_t i : vHits)
+        hits.prevouts.push_back(snapshot.prevouts[i]);
+
+    return !hits.prevouts.empty();
+}
+
+void PrecomputeStakeKernels(const StakeSnapshot& snapshot, uint32_t nTimeFrom, unsigned int nSlots, StakeSchedule& schedule)
+{
+    const uint32_t nSlotSpacing = Params().GetConsensus().nStakeTimestampMask + 1;
+    schedule.hashPrevBlock = snapshot.hashPrevBlock;
+    schedule.nTimeFrom = nTimeFrom;
+    schedule.nTimeTo = nTimeFrom + (nSlots - 1) * nSlotSpacing;
+    schedule.hits.clear();
+
+    std::vector<size_t> vHits;
+    for (uint32_t nTime = schedule.nTimeFrom; nTime <= schedule.nTimeTo; nTime += nSlotSpacing) {
+        vHits.clear();
+        CheckStakeKernelHashBatch(snapshot.kernels, nTime, vHits);
+        if (vHits.empty())
+            continue;
+        std::vector<COutPoint>& prevouts = schedule.hits[nTime];
+        for (size_t i : vHits)
+            prevouts.push_back(snapshot.prevouts[i]);
+    }
+}
+
+bool GetScheduledKernels(const StakeSchedule& schedule, uint32_t nTime, StakeKernelHits& hits)
+{
+    hits.hashPrevBlock = schedule.hashPrevBlock;
+    hits.nTime = nTime;
+    hits.prevouts.clear();
+
+    auto it = schedule.hits.find(nTime);
+    if (it != schedule.hits.end())
+        hits.prevouts = it->second;
+
+    return !hits.prevouts.empty();
+}
+
 // peercoin: create coin stake transaction
 typedef std::vector<unsigned char> valtype;
-bool CreateCoinStake(CWallet& wallet, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& txNew, CAmount& nFees, CTxDestination destination)
+bool CreateCoinStake(CWallet& wallet, unsigned int nBits, const std::vector<COutPoint>& vKernels, CMutableTransaction& txNew, CAmount& nFees, CTxDestination destination, const StakeSigningContext* signing)
 {
     bool fAllowWatchOnly = wallet.IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS);
     CBlockIndex* pindexPrev = wallet.chain().getTip();
-    arith_uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-
-    // Transaction index is required to get to block header
-    if (!g_txindex)
-        return error("CreateCoinStake : transaction index unavailable");
 
     LOCK2(cs_main, wallet.cs_wallet);
     txNew.vin.clear();
@@ -291,108 +501,105 @@ bool CreateCoinStake(CWallet& wallet, unsigned int nBits, int64_t nSearchInterva
     CScript scriptPubKeyKernel, scriptPubKeyOut;
     bool bMinterKey = false;
 
-    for (const std::pair<const CWalletTx*, unsigned int> &pcoin : setCoins)
+    CCoinsViewCache& view = wallet.chain().getCoinsTip();
+    for (const COutPoint& prevoutStake : vKernels)
     {
-        uint256 blockHash;
-        CTransactionRef tx;
-        if (!g_txindex->FindTx(pcoin.first->GetHash(), blockHash, tx)) {
-            LogPrintf("couldnt retrieve tx %s\n", *pcoin.first->GetHash().ToString().c_str());
+        // The kernel was found on a snapshot without holding the locks,
+        // so check that the coin is still selected and re-check the kernel
+        const CWalletTx* wtx = wallet.GetWalletTx(prevoutStake.hash);
+        if (!wtx || !setCoins.count(std::make_pair(wtx, prevoutStake.n)))
             continue;
-        }
-
-        static int nMaxStakeSearchInterval = 60;
-        for (unsigned int n=0; n<std::min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound; n++)
+        const std::pair<const CWalletTx*, unsigned int> pcoin(wtx, prevoutStake.n);
+        if (CheckKernel(pindexPrev, nBits, txNew.nTime, prevoutStake, view))
         {
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, wallet.chain().getCoinsTip()))
+            // Found a kernel
+            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel found\n");
+            std::vector<valtype> vSolutions;
+            scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
+            const StakeSigningContext::Script* prepared = signing ? signing->FindScript(scriptPubKeyKernel) : nullptr;
+            TxoutType whichType = prepared ? prepared->type : Solver(scriptPubKeyKernel, vSolutions);
+
+            if (whichType != TxoutType::PUBKEY && whichType != TxoutType::PUBKEYHASH && whichType != TxoutType::WITNESS_V0_KEYHASH && whichType != TxoutType::WITNESS_V1_TAPROOT)
             {
-                // Found a kernel
-                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel found\n");
-                std::vector<valtype> vSolutions;
-                scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
-                TxoutType whichType = Solver(scriptPubKeyKernel, vSolutions);
-
-                if (whichType != TxoutType::PUBKEY && whichType != TxoutType::PUBKEYHASH && whichType != TxoutType::WITNESS_V0_KEYHASH && whichType != TxoutType::WITNESS_V1_TAPROOT)
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : no support for kernel type=%s\n", GetTxnOutputType(whichType));
-                    break;  // only support pay to public key and pay to address and pay to witness keyhash
-                }
-                if (whichType == TxoutType::PUBKEYHASH) // pay to address
-                {
-                    // convert to pay to public key type
-                    CKey key;
-                    if (wallet.IsLegacy()) {
-                        auto scriptPubKeyMan = wallet.GetLegacyScriptPubKeyMan();
-                        if (!scriptPubKeyMan) {
-                            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get scriptpubkeyman for kernel type=%s\n", GetTxnOutputType(whichType));
-                            break;  // unable to find corresponding public key
-                        }
-                        if (!scriptPubKeyMan->GetKey(CKeyID(uint160(vSolutions[0])), key))
-                        {
-                            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%s\n", GetTxnOutputType(whichType));
-                            break;  // unable to find corresponding public key
-                        }
-                        scriptPubKeyOut << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : no support for kernel type=%s\n", GetTxnOutputType(whichType));
+                continue;  // only support pay to public key and pay to address and pay to witness keyhash
+            }
+            if (prepared)
+            {
+                // The output key was looked up with the coin's script
+                scriptPubKeyOut = prepared->scriptPubKeyOut;
+                bMinterKey = prepared->fMinterKey;
+            }
+            else if (whichType == TxoutType::PUBKEYHASH) // pay to address
+            {
+                // convert to pay to public key type
+                CKey key;
+                if (wallet.IsLegacy()) {
+                    auto scriptPubKeyMan = wallet.GetLegacyScriptPubKeyMan();
+                    if (!scriptPubKeyMan) {
+                        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get scriptpubkeyman for kernel type=%s\n", GetTxnOutputType(whichType));
+                        continue;  // unable to find corresponding public key
                     }
-                    else {
-                        std::unique_ptr<SigningProvider> provider = wallet.GetSolvingProvider(scriptPubKeyKernel);
-                        if (!provider) {
-                            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get signing provider for output %s\n", pcoin.first->tx->vout[pcoin.second].ToString());
-                            break;
-                        }
-                        CKeyID ckey = CKeyID(uint160(vSolutions[0]));
-                        CPubKey pkey;
-                        if (!provider.get()->GetPubKey(ckey, pkey)) {
-                            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for output %s\n", pcoin.first->tx->vout[pcoin.second].ToString());
-                            break;
-                        }
-                        scriptPubKeyOut << ToByteVector(pkey) << OP_CHECKSIG;
+                    if (!scriptPubKeyMan->GetKey(CKeyID(uint160(vSolutions[0])), key))
+                    {
+                        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%s\n", GetTxnOutputType(whichType));
+                        continue;  // unable to find corresponding public key
                     }
+                    scriptPubKeyOut << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
                 }
-                else if (whichType == TxoutType::PUBKEY)
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                else if (whichType == TxoutType::WITNESS_V0_KEYHASH || whichType == TxoutType::WITNESS_V1_TAPROOT) // pay to witness keyhash
-                {
-                    std::vector<valtype> vSolutionsTmp;
-                    CScript scriptPubKeyTmp = GetScriptForDestination(destination);
-                    Solver(scriptPubKeyTmp, vSolutionsTmp);
-                    std::unique_ptr<SigningProvider> provider = wallet.GetSolvingProvider(scriptPubKeyTmp);
+                else {
+                    std::unique_ptr<SigningProvider> provider = wallet.GetSolvingProvider(scriptPubKeyKernel);
                     if (!provider) {
                         LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get signing provider for output %s\n", pcoin.first->tx->vout[pcoin.second].ToString());
-                        break;
+                        continue;
                     }
-                    CKeyID ckey = CKeyID(uint160(vSolutionsTmp[0]));
+                    CKeyID ckey = CKeyID(uint160(vSolutions[0]));
                     CPubKey pkey;
                     if (!provider.get()->GetPubKey(ckey, pkey)) {
                         LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for output %s\n", pcoin.first->tx->vout[pcoin.second].ToString());
-                        break;
+                        continue;
                     }
                     scriptPubKeyOut << ToByteVector(pkey) << OP_CHECKSIG;
-                    bMinterKey = true;
                 }
+            }
+            else if (whichType == TxoutType::PUBKEY)
+                scriptPubKeyOut = scriptPubKeyKernel;
+            else if (whichType == TxoutType::WITNESS_V0_KEYHASH || whichType == TxoutType::WITNESS_V1_TAPROOT) // pay to witness keyhash
+            {
+                std::vector<valtype> vSolutionsTmp;
+                CScript scriptPubKeyTmp = GetScriptForDestination(destination);
+                Solver(scriptPubKeyTmp, vSolutionsTmp);
+                std::unique_ptr<SigningProvider> provider = wallet.GetSolvingProvider(scriptPubKeyTmp);
+                if (!provider) {
+                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get signing provider for output %s\n", pcoin.first->tx->vout[pcoin.second].ToString());
+                    continue;
+                }
+                CKeyID ckey = CKeyID(uint160(vSolutionsTmp[0]));
+                CPubKey pkey;
+                if (!provider.get()->GetPubKey(ckey, pkey)) {
+                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for output %s\n", pcoin.first->tx->vout[pcoin.second].ToString());
+                    continue;
+                }
+                scriptPubKeyOut << ToByteVector(pkey) << OP_CHECKSIG;
+                bMinterKey = true;
+            }
 
-                txNew.nTime -= n;
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-                vwtxPrev.push_back(tx);
+            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+            nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
+            vwtxPrev.push_back(pcoin.first->tx);
 
-                if (bMinterKey) {
-                    // extra output for minter key
-                    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-                    // redefine scriptPubKeyOut to send output to input address
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                }
-    
+            if (bMinterKey) {
+                // extra output for minter key
                 txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : added kernel type=%d\n", (int)whichType);
-                fKernelFound = true;
-                break;
+                // redefine scriptPubKeyOut to send output to input address
+                scriptPubKeyOut = scriptPubKeyKernel;
             }
+
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : added kernel type=%d\n", (int)whichType);
+            fKernelFound = true;
+            break;
         }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
     }
     if (!fKernelFound)
         return false;
@@ -401,13 +608,6 @@ bool CreateCoinStake(CWallet& wallet, unsigned int nBits, int64_t nSearchInterva
 
     for (const std::pair<const CWalletTx*, unsigned int> &pcoin : setCoins)
     {
-        uint256 blockHash;
-        CTransactionRef tx;
-        if (!g_txindex->FindTx(pcoin.first->GetHash(), blockHash, tx)) {
-            LogPrintf("couldnt retrieve tx %s\n", *pcoin.first->GetHash().ToString().c_str());
-            continue;
-        }
-
         // Attempt to add more inputs
         // Only add coins of the same key/address as kernel
         if (txNew.vout.size() == 2 && ((pcoin.first->tx->vout[pcoin.second].scriptPubKey == scriptPubKeyKernel || pcoin.first->tx->vout[pcoin.second].scriptPubKey == txNew.vout[1].scriptPubKey))
@@ -428,7 +628,7 @@ bool CreateCoinStake(CWallet& wallet, unsigned int nBits, int64_t nSearchInterva
 
             txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
             nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(tx);
+            vwtxPrev.push_back(pcoin.first->tx);
         }
     }
 
@@ -473,10 +673,16 @@ bool CreateCoinStake(CWallet& wallet, unsigned int nBits, int64_t nSearchInterva
             txNew.vout[2 + bMinterKey].nValue = nDevCredit;
     }
 
-    // Sign
+    // Sign, with the keys of the stake snapshot if it has all of them
+    std::vector<CTxOut> spent_outputs;
+    for (size_t i = 0; i < txNew.vin.size(); i++)
+        spent_outputs.push_back(vwtxPrev[i]->vout[txNew.vin[i].prevout.n]);
     int nIn = 0;
 
-    if (wallet.IsLegacy()) {
+    if (signing && SignStakeInputs(wallet, txNew, spent_outputs, *signing)) {
+        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : signed with the prepared keys\n");
+    }
+    else if (wallet.IsLegacy()) {
         for (const auto &pcoin : vwtxPrev) {
             SignatureData empty;
             if (!SignSignature(*wallet.GetLegacyScriptPubKeyMan(), *pcoin, txNew, nIn++, SIGHASH_ALL, empty))
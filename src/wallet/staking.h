@@ -8,9 +8,14 @@
 #ifndef BLACKCOIN_WALLET_STAKE_H
 #define BLACKCOIN_WALLET_STAKE_H
 
+#include <key.h>
+#include <script/solver.h>
 #include <wallet/spend.h>
 #include <wallet/wallet.h>
 
+#include <map>
+#include <optional>
+
 namespace wallet {
 /* Start staking */
 void StartStake(CWallet& wallet);
@@ -24,7 +29,84 @@ void AvailableCoinsForStaking(const CWallet& wallet,
                            const CCoinControl* coinControl = nullptr,
                            const CoinFilterParams& params = {}) EXCLUSIVE_LOCKS_REQUIRED(wallet.cs_wallet);
 bool SelectCoinsForStaking(const CWallet& wallet, CAmount& nTargetValue, std::set<std::pair<const CWalletTx *, unsigned int> > &setCoinsRet, CAmount& nValueRet);
-bool CreateCoinStake(CWallet& wallet, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& tx, CAmount& nFees, CTxDestination destination); 
+
+/** Keys of the coins a wallet stakes with, looked up once per script when a coin first
+ *  shows up in a snapshot. A kernel is then turned into a signed coinstake and block with
+ *  plain signatures, without solving scripts or asking the script pubkey managers. */
+struct StakeSigningContext
+{
+    struct Script {
+        TxoutType type;
+        //! Key of the kernel input
+        CKeyID keyid;
+        //! Coinstake output of a kernel with this script, pay to public key
+        CScript scriptPubKeyOut;
+        //! Whether scriptPubKeyOut pays to the staking address, the kernel script then gets an output of its own
+        bool fMinterKey{false};
+    };
+
+    //! Staking address of the witness kernels, the context is reset when it changes
+    CTxDestination dest;
+    //! Scripts looked up, nullopt for those left to the generic signing path
+    std::map<CScript, std::optional<Script>> scripts;
+    std::map<CKeyID, std::pair<CKey, CPubKey>> keys;
+
+    const Script* FindScript(const CScript& script) const;
+    const std::pair<CKey, CPubKey>* FindKey(const CKeyID& keyid) const;
+};
+
+/** Chain tip and prepared stake kernels of the wallet, searched without holding cs_main or cs_wallet */
+struct StakeSnapshot
+{
+    uint256 hashPrevBlock;
+    unsigned int nBits{0};
+    std::vector<COutPoint> prevouts;
+    std::vector<CStakeKernel> kernels;
+    //! Kept from one snapshot to the next while the wallet is unlocked, and only
+    //! signed with while it still is
+    StakeSigningContext signing;
+};
+
+/** Kernels of a snapshot meeting the stake target at nTime */
+struct StakeKernelHits
+{
+    uint256 hashPrevBlock;
+    uint32_t nTime{0};
+    std::vector<COutPoint> prevouts;
+    //! Keys of the snapshot the kernels were found in, if any
+    const StakeSigningContext* signing{nullptr};
+};
+
+//! Number of masked timestamp slots evaluated ahead of time per tip, about the
+//! target spacing, as most of the kernels are for nothing once the next tip comes
+static constexpr unsigned int STAKE_AHEAD_SLOTS{4};
+
+/** Kernels of a snapshot meeting the stake target in each of a range of upcoming
+ *  timestamp slots. The stake modifier, target and kernel inputs only depend on the
+ *  tip, so the slots are evaluated as soon as the tip is known. */
+struct StakeSchedule
+{
+    uint256 hashPrevBlock;
+    uint32_t nTimeFrom{0};
+    uint32_t nTimeTo{0};
+    std::map<uint32_t, std::vector<COutPoint>> hits;
+};
+
+/* Capture the tip and the wallet's stake candidates, only holding the locks briefly.
+ * The keys of new candidate scripts, and of dest, are added to the signing context. */
+bool CreateStakeSnapshot(CWallet& wallet, StakeSnapshot& snapshot, const CTxDestination& dest = CNoDestination());
+/* Search the snapshot for kernels at the given coinstake time, does not take any lock */
+bool FindStakeKernels(const StakeSnapshot& snapshot, uint32_t nTime, StakeKernelHits& hits);
+/* Search the snapshot for kernels in nSlots slots starting at nTimeFrom, does not take any lock */
+void PrecomputeStakeKernels(const StakeSnapshot& snapshot, uint32_t nTimeFrom, unsigned int nSlots, StakeSchedule& schedule);
+/* Kernels of the schedule at the given coinstake time, false if there are none or the time is not covered */
+bool GetScheduledKernels(const StakeSchedule& schedule, uint32_t nTime, StakeKernelHits& hits);
+/* Sign the inputs of a coinstake spending spent_outputs, false if a key is missing from the context.
+ * The context may still hold the keys of a wallet locked since it was prepared, they are then not used. */
+bool SignStakeInputs(const CWallet& wallet, CMutableTransaction& tx, const std::vector<CTxOut>& spent_outputs, const StakeSigningContext& signing) EXCLUSIVE_LOCKS_REQUIRED(wallet.cs_wallet);
+/* Create the coinstake for the first kernel that is still valid, tx.nTime is the kernel time.
+ * Signed with the keys of the signing context if it has them all. */
+bool CreateCoinStake(CWallet& wallet, unsigned int nBits, const std::vector<COutPoint>& vKernels, CMutableTransaction& tx, CAmount& nFees, CTxDestination destination, const StakeSigningContext* signing = nullptr);
 
 } // namespace wallet
 
@@ -26,6 +26,7 @@
 #include <wallet/context.h>
 #include <wallet/receive.h>
 #include <wallet/spend.h>
+#include <wallet/staking.h>
 #include <wallet/test/util.h>
 #include <wallet/test/wallet_test_fixture.h>
 
@@ -668,6 +669,207 @@ BOOST_FIXTURE_TEST_CASE(BasicOutputTypesTest, ListCoinsTest)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(stakeable_outputs, ListCoinsTestingSetup)
+{
+    auto staking_coins = [&] {
+        LOCK(wallet->cs_wallet);
+        std::vector<std::pair<const CWalletTx*, unsigned int>> coins;
+        AvailableCoinsForStaking(*wallet, coins);
+        std::set<COutPoint> outpoints;
+        for (const auto& [wtx, n] : coins) outpoints.emplace(wtx->GetHash(), n);
+        return outpoints;
+    };
+
+    // Let the coinbase to coinbaseKey mature
+    for (int i = 0; i < Params().GetConsensus().nCoinbaseMaturity; i++) {
+        CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    }
+    {
+        LOCK2(wallet->cs_wallet, ::cs_main);
+        wallet->SetLastBlockProcessed(m_node.chainman->ActiveChain().Height(), m_node.chainman->ActiveChain().Tip()->GetBlockHash());
+    }
+    const std::set<COutPoint> initial{staking_coins()};
+    BOOST_REQUIRE(!initial.empty());
+
+    // Spend a stakeable coin without broadcasting the transaction
+    const COutPoint spent{*initial.begin()};
+    CCoinControl coin_control;
+    coin_control.m_allow_other_inputs = false;
+    coin_control.Select(spent);
+    auto res = CreateTransaction(*wallet, {CRecipient{PubKeyDestination{{}}, 1 * COIN, /*fSubtractFeeFromAmount=*/false}}, /*change_pos=*/-1, coin_control);
+    BOOST_REQUIRE(res);
+    wallet->CommitTransaction(res->tx, {}, {});
+
+    std::set<COutPoint> expected{initial};
+    expected.erase(spent);
+    BOOST_CHECK(staking_coins() == expected);
+
+    // Abandoning the spend makes the coin stakeable again
+    BOOST_CHECK(wallet->AbandonTransaction(res->tx->GetHash()));
+    BOOST_CHECK(staking_coins() == initial);
+
+    // Rebuilding the outputs from mapWallet gives the same coins
+    wallet->MarkDirty();
+    BOOST_CHECK(staking_coins() == initial);
+}
+
+BOOST_FIXTURE_TEST_CASE(stake_signing_context, ListCoinsTestingSetup)
+{
+    // Coins paying to the key hash and the witness key hash of the key too
+    const CScript p2pkh{GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()))};
+    const CScript p2wpkh{GetScriptForDestination(WitnessV0KeyHash(coinbaseKey.GetPubKey()))};
+    const CTransactionRef p2pkh_coinbase{CreateAndProcessBlock({}, p2pkh).vtx[0]};
+    const CTransactionRef p2wpkh_coinbase{CreateAndProcessBlock({}, p2wpkh).vtx[0]};
+    for (int i = 0; i < Params().GetConsensus().nCoinbaseMaturity; i++) {
+        CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    }
+    {
+        WalletRescanReserver reserver(*wallet);
+        reserver.reserve();
+        const uint256 genesis{WITH_LOCK(::cs_main, return m_node.chainman->ActiveChain().Genesis()->GetBlockHash())};
+        BOOST_CHECK(wallet->ScanForWalletTransactions(genesis, /*start_height=*/0, /*max_height=*/{}, reserver, /*fUpdate=*/false, /*save_progress=*/false).status == CWallet::ScanResult::SUCCESS);
+        LOCK2(wallet->cs_wallet, ::cs_main);
+        wallet->SetLastBlockProcessed(m_node.chainman->ActiveChain().Height(), m_node.chainman->ActiveChain().Tip()->GetBlockHash());
+    }
+
+    // The keys of the stakeable coins are looked up with the snapshot
+    StakeSnapshot snapshot;
+    BOOST_REQUIRE(CreateStakeSnapshot(*wallet, snapshot));
+    const CScript script{GetScriptForRawPubKey(coinbaseKey.GetPubKey())};
+    const StakeSigningContext::Script* prepared{snapshot.signing.FindScript(script)};
+    BOOST_REQUIRE(prepared);
+    BOOST_CHECK(prepared->type == TxoutType::PUBKEY);
+    BOOST_CHECK(prepared->scriptPubKeyOut == script);
+    BOOST_CHECK(!prepared->fMinterKey);
+    BOOST_REQUIRE(snapshot.signing.FindKey(coinbaseKey.GetPubKey().GetID()));
+
+    // The inputs are signed as the wallet would, without asking it
+    BOOST_REQUIRE(snapshot.prevouts.size() >= 2);
+    CMutableTransaction tx;
+    std::vector<CTxOut> spent_outputs;
+    for (size_t i = 0; i < 2; i++) {
+        tx.vin.emplace_back(COutPoint(snapshot.prevouts[i]));
+        spent_outputs.emplace_back(100 * COIN, script);
+    }
+    tx.vout.emplace_back(0, CScript());
+    tx.vout.emplace_back(200 * COIN, prepared->scriptPubKeyOut);
+    BOOST_REQUIRE(WITH_LOCK(wallet->cs_wallet, return SignStakeInputs(*wallet, tx, spent_outputs, snapshot.signing)));
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        ScriptError error;
+        BOOST_CHECK(VerifyScript(tx.vin[i].scriptSig, script, &tx.vin[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS,
+                                 MutableTransactionSignatureChecker(&tx, i, spent_outputs[i].nValue, MissingDataBehavior::FAIL), &error));
+    }
+
+    // The context is kept across snapshots, and does not sign for unknown scripts
+    BOOST_REQUIRE(CreateStakeSnapshot(*wallet, snapshot));
+    BOOST_CHECK(snapshot.signing.FindScript(script));
+    spent_outputs[1].scriptPubKey = CScript() << OP_TRUE;
+    BOOST_CHECK(!WITH_LOCK(wallet->cs_wallet, return SignStakeInputs(*wallet, tx, spent_outputs, snapshot.signing)));
+
+    // A new staking address resets it
+    BOOST_REQUIRE(CreateStakeSnapshot(*wallet, snapshot, PKHash(coinbaseKey.GetPubKey())));
+    BOOST_CHECK(snapshot.signing.dest == CTxDestination{PKHash(coinbaseKey.GetPubKey())});
+    BOOST_CHECK(snapshot.signing.FindScript(script));
+
+    // Key hash kernels get a pay to public key output, and witness kernels an
+    // extra one paying to the key of the staking address
+    const StakeSigningContext::Script* prepared_p2pkh{snapshot.signing.FindScript(p2pkh)};
+    const StakeSigningContext::Script* prepared_p2wpkh{snapshot.signing.FindScript(p2wpkh)};
+    BOOST_REQUIRE(prepared_p2pkh && prepared_p2wpkh);
+    BOOST_CHECK(prepared_p2pkh->type == TxoutType::PUBKEYHASH);
+    BOOST_CHECK(prepared_p2pkh->scriptPubKeyOut == script);
+    BOOST_CHECK(!prepared_p2pkh->fMinterKey);
+    BOOST_CHECK(prepared_p2wpkh->type == TxoutType::WITNESS_V0_KEYHASH);
+    BOOST_CHECK(prepared_p2wpkh->scriptPubKeyOut == script);
+    BOOST_CHECK(prepared_p2wpkh->fMinterKey);
+
+    CMutableTransaction kernel_tx;
+    const std::vector<CTxOut> kernel_outputs{p2pkh_coinbase->vout[0], p2wpkh_coinbase->vout[0]};
+    kernel_tx.vin.emplace_back(COutPoint(p2pkh_coinbase->GetHash(), 0));
+    kernel_tx.vin.emplace_back(COutPoint(p2wpkh_coinbase->GetHash(), 0));
+    kernel_tx.vout.emplace_back(0, CScript());
+    kernel_tx.vout.emplace_back(0, prepared_p2wpkh->scriptPubKeyOut);
+    kernel_tx.vout.emplace_back(kernel_outputs[0].nValue + kernel_outputs[1].nValue, p2wpkh);
+    BOOST_REQUIRE(WITH_LOCK(wallet->cs_wallet, return SignStakeInputs(*wallet, kernel_tx, kernel_outputs, snapshot.signing)));
+    BOOST_CHECK(kernel_tx.vin[0].scriptWitness.IsNull());
+    BOOST_CHECK(kernel_tx.vin[1].scriptSig.empty());
+    for (unsigned int i = 0; i < kernel_tx.vin.size(); i++) {
+        ScriptError error;
+        BOOST_CHECK(VerifyScript(kernel_tx.vin[i].scriptSig, kernel_outputs[i].scriptPubKey, &kernel_tx.vin[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS,
+                                 MutableTransactionSignatureChecker(&kernel_tx, i, kernel_outputs[i].nValue, MissingDataBehavior::FAIL), &error));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(stake_signing_locked_wallet, TestingSetup)
+{
+    auto wallet = std::make_unique<CWallet>(m_node.chain.get(), "", CreateMockableWalletDatabase());
+    {
+        LOCK(wallet->cs_wallet);
+        wallet->SetWalletFlag(WALLET_FLAG_DESCRIPTORS);
+        wallet->SetupDescriptorScriptPubKeyMans();
+    }
+
+    // Context of a key hash kernel, prepared while the wallet was unlocked
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript p2pkh{GetScriptForDestination(PKHash(key.GetPubKey()))};
+    StakeSigningContext signing;
+    signing.keys.emplace(key.GetPubKey().GetID(), std::make_pair(key, key.GetPubKey()));
+    signing.scripts.emplace(p2pkh, StakeSigningContext::Script{TxoutType::PUBKEYHASH, key.GetPubKey().GetID(), GetScriptForRawPubKey(key.GetPubKey())});
+
+    CMutableTransaction tx;
+    const std::vector<CTxOut> spent_outputs{CTxOut(100 * COIN, p2pkh)};
+    tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    tx.vout.emplace_back(0, CScript());
+    tx.vout.emplace_back(100 * COIN, signing.scripts.at(p2pkh)->scriptPubKeyOut);
+
+    BOOST_REQUIRE(wallet->EncryptWallet("stake"));
+    BOOST_REQUIRE(wallet->Unlock("stake"));
+    BOOST_CHECK(WITH_LOCK(wallet->cs_wallet, return SignStakeInputs(*wallet, tx, spent_outputs, signing)));
+    ScriptError error;
+    BOOST_CHECK(VerifyScript(tx.vin[0].scriptSig, p2pkh, &tx.vin[0].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS,
+                             MutableTransactionSignatureChecker(&tx, 0, spent_outputs[0].nValue, MissingDataBehavior::FAIL), &error));
+
+    // The keys are still in the context, but are not signed with once the wallet is locked
+    BOOST_REQUIRE(wallet->Lock());
+    BOOST_CHECK(!WITH_LOCK(wallet->cs_wallet, return SignStakeInputs(*wallet, tx, spent_outputs, signing)));
+}
+
+BOOST_FIXTURE_TEST_CASE(stake_schedule, BasicTestingSetup)
+{
+    // Easy target so that most slots have kernels
+    StakeSnapshot snapshot;
+    snapshot.hashPrevBlock = InsecureRand256();
+    snapshot.nBits = 0x1c00ffff;
+    const uint256 modifier{InsecureRand256()};
+    const uint32_t nTimeFrom = 1700000000 & ~Params().GetConsensus().nStakeTimestampMask;
+    for (int i = 0; i < 100; i++) {
+        const COutPoint prevout(InsecureRand256(), InsecureRandRange(4));
+        CStakeKernel kernel;
+        BOOST_REQUIRE(PrepareStakeKernel(modifier, snapshot.nBits, nTimeFrom - 100000, 1 + InsecureRandRange(1000 * COIN), prevout, kernel));
+        snapshot.prevouts.push_back(prevout);
+        snapshot.kernels.push_back(kernel);
+    }
+
+    StakeSchedule schedule;
+    PrecomputeStakeKernels(snapshot, nTimeFrom, STAKE_AHEAD_SLOTS, schedule);
+    BOOST_CHECK(schedule.hashPrevBlock == snapshot.hashPrevBlock);
+    BOOST_CHECK(!schedule.hits.empty());
+
+    // Every slot of the schedule gives the kernels a search at that time finds
+    const uint32_t nSlotSpacing = Params().GetConsensus().nStakeTimestampMask + 1;
+    for (uint32_t nTime = nTimeFrom; nTime <= schedule.nTimeTo; nTime += nSlotSpacing) {
+        StakeKernelHits found, scheduled;
+        BOOST_CHECK_EQUAL(FindStakeKernels(snapshot, nTime, found), GetScheduledKernels(schedule, nTime, scheduled));
+        BOOST_CHECK(found.prevouts == scheduled.prevouts);
+        BOOST_CHECK_EQUAL(scheduled.nTime, nTime);
+    }
+    BOOST_CHECK_EQUAL(schedule.nTimeTo, nTimeFrom + (STAKE_AHEAD_SLOTS - 1) * nSlotSpacing);
+
+    StakeKernelHits hits;
+    BOOST_CHECK(!GetScheduledKernels(schedule, schedule.nTimeTo + nSlotSpacing, hits));
+}
+
 BOOST_FIXTURE_TEST_CASE(wallet_disableprivkeys, TestChain100Setup)
 {
     {
@@ -966,6 +966,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        m_stakeable_outputs_dirty = true;
     }
 }
 
@@ -1102,6 +1103,8 @@ CWalletTx* CWallet::AddToWallet(CTransactionRef tx, const TxState& state, const
         }
     }
 
+    AddStakeableOutputs(wtx);
+
     //// debug print
     WalletLogPrintf("AddToWallet %s  %s%s %s\n", hash.ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""), TxStateString(state));
 
@@ -1275,6 +1278,11 @@ void CWallet::MarkInputsDirty(const CTransactionRef& tx)
         if (it != mapWallet.end()) {
             it->second.MarkDirty();
         }
+        // The input may be unspent again, GetStakeableOutputs() checks it
+        auto node = m_stakeable_spent.extract(txin.prevout);
+        if (node) {
+            m_stakeable_outputs.insert(std::move(node));
+        }
     }
 }
 
@@ -1454,6 +1462,15 @@ void CWallet::blockConnected(ChainstateRole role, const interfaces::BlockInfo& b
     m_last_block_processed_height = block.height;
     m_last_block_processed = block.hash;
 
+    // Drop kernel cache entries of coins spent by this block
+    if (!m_stake_cache.empty()) {
+        for (const CTransactionRef& ptx : block.data->vtx) {
+            for (const CTxIn& txin : ptx->vin) {
+                m_stake_cache.erase(txin.prevout);
+            }
+        }
+    }
+
     // No need to scan block if it was created before the wallet birthday.
     // Uses chain max time and twice the grace period to adjust time for block time variability.
     if (block.chain_time_max < m_birth_time.load() - (TIMESTAMP_WINDOW * 2)) return;
@@ -1482,6 +1499,12 @@ void CWallet::blockDisconnected(const interfaces::BlockInfo& block)
     for (const CTransactionRef& ptx : Assert(block.data)->vtx) {
         SyncTransaction(ptx, TxStateInactive{});
 
+        // The block time of disconnected outputs may change once they are mined again,
+        // so their cached kernel data is no longer valid
+        for (unsigned int i = 0; i < ptx->vout.size() && !m_stake_cache.empty(); i++) {
+            m_stake_cache.erase(COutPoint(ptx->GetHash(), i));
+        }
+
         for (const CTxIn& tx_in : ptx->vin) {
             // No other wallet transactions conflicted with this transaction
             if (mapTxSpends.count(tx_in.prevout) < 1) continue;
@@ -1515,6 +1538,7 @@ void CWallet::blockDisconnected(const interfaces::BlockInfo& block)
 void CWallet::updatedBlockTip()
 {
     m_best_block_time = GetTime();
+    if (m_chain) m_chain->notifyStake();
 }
 
 void CWallet::BlockUntilSyncedToCurrentChain() const {
@@ -2361,6 +2385,8 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
         for (const auto& txin : it->second.tx->vin)
             mapTxSpends.erase(txin.prevout);
         mapWallet.erase(it);
+        // The stakeable outputs point into mapWallet, rebuild them even if we return early below
+        m_stakeable_outputs_dirty = true;
         NotifyTransactionChanged(hash, CT_DELETED);
     }
 
@@ -2437,6 +2463,63 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
     return batch.EraseName(EncodeDestination(address));
 }
 
+void CWallet::AddStakeableOutputs(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+
+    // Everything is added when the outputs are rebuilt
+    if (m_stakeable_outputs_dirty) return;
+
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        const COutPoint outpoint(wtx.GetHash(), i);
+        if (m_stakeable_outputs.count(outpoint) || m_stakeable_spent.count(outpoint))
+            continue;
+
+        const CTxOut& output = wtx.tx->vout[i];
+        isminetype mine = IsMine(output);
+        if (mine == ISMINE_NO)
+            continue;
+
+        std::unique_ptr<SigningProvider> provider = GetSolvingProvider(output.scriptPubKey);
+        bool solvable = provider ? InferDescriptor(output.scriptPubKey, *provider)->IsSolvable() : false;
+
+        // Solvable P2SH outputs are only staked if the redeem script is known
+        if (output.scriptPubKey.IsPayToScriptHash() && solvable) {
+            CTxDestination destination;
+            CScript script;
+            if (!ExtractDestination(output.scriptPubKey, destination))
+                continue;
+            if (!provider->GetCScript(ToScriptID(std::get<ScriptHash>(destination)), script))
+                continue;
+        }
+
+        m_stakeable_outputs.emplace(outpoint, StakeableOutput{&wtx, mine, solvable});
+    }
+}
+
+const std::map<COutPoint, CWallet::StakeableOutput>& CWallet::GetStakeableOutputs() const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (m_stakeable_outputs_dirty) {
+        m_stakeable_outputs.clear();
+        m_stakeable_spent.clear();
+        m_stakeable_outputs_dirty = false;
+        for (const auto& entry : mapWallet) {
+            AddStakeableOutputs(entry.second);
+        }
+    }
+
+    for (auto it = m_stakeable_outputs.begin(); it != m_stakeable_outputs.end();) {
+        if (IsSpent(it->first)) {
+            m_stakeable_spent.insert(m_stakeable_outputs.extract(it++));
+        } else {
+            ++it;
+        }
+    }
+    return m_stakeable_outputs;
+}
+
 uint64_t CWallet::GetStakeWeight() const
 {
     if (HaveChain()) {
@@ -3109,6 +3192,8 @@ std::shared_ptr<CWallet> CWallet::Create(WalletContext& context, const std::stri
     donation_percentage = std::min(donation_percentage, MAX_DONATION_PERCENTAGE);
     walletInstance->m_donation_percentage = donation_percentage;
 
+    walletInstance->m_use_stake_cache = args.GetBoolArg("-stakecache", node::DEFAULT_STAKE_CACHE);
+
     walletInstance->WalletLogPrintf("Wallet completed loading in %15dms\n", Ticks<std::chrono::milliseconds>(SteadyClock::now() - start));
 
     // Try to top up keypool. No-op if the wallet is locked.
@@ -325,8 +325,6 @@ private:
     // Local time that the tip block was received. Used to schedule wallet rebroadcasts.
     std::atomic<int64_t> m_best_block_time {0};
 
-    std::map<COutPoint, CStakeCache> stakeCache;
-
     // First created key time. Used to skip blocks prior to this time.
     // 'std::numeric_limits<int64_t>::max()' if wallet is blank.
     std::atomic<int64_t> m_birth_time{std::numeric_limits<int64_t>::max()};
@@ -372,6 +370,9 @@ private:
     /** Mark a transaction's inputs dirty, thus forcing the outputs to be recomputed */
     void MarkInputsDirty(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /** Add the owned outputs of a transaction to the stakeable outputs */
+    void AddStakeableOutputs(const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     void SyncTransaction(const CTransactionRef& tx, const SyncTxState& state, bool update_tx = true, bool rescanning_old_block = false) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
@@ -726,6 +727,28 @@ public:
     std::atomic<bool> m_stop_staking_thread{false};
     uint64_t GetStakeWeight() const;
 
+    //! Whether the kernel cache below is used by the staker (-stakecache)
+    bool m_use_stake_cache{false};
+    //! Kernel data (blockFromTime, amount) of staking candidates, kept across staking rounds.
+    //! Entries are dropped when the coin is spent or its containing block is disconnected.
+    std::map<COutPoint, CStakeCache> m_stake_cache GUARDED_BY(cs_wallet);
+
+    //! Owned output that can be staked once it is mature, with the ownership checks done when it was added
+    struct StakeableOutput {
+        const CWalletTx* wtx;
+        isminetype mine;
+        bool solvable;
+    };
+    /** Owned outputs that are not spent, maintained as transactions are added and change
+     *  state so that staking rounds don't scan mapWallet or infer descriptors. Spent
+     *  outputs are moved to m_stakeable_spent here and come back when a transaction
+     *  spending them changes state. Depth and trust are left to the caller. */
+    const std::map<COutPoint, StakeableOutput>& GetStakeableOutputs() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    mutable std::map<COutPoint, StakeableOutput> m_stakeable_outputs GUARDED_BY(cs_wallet);
+    mutable std::map<COutPoint, StakeableOutput> m_stakeable_spent GUARDED_BY(cs_wallet);
+    //! Set when ownership of wallet outputs may have changed, the stakeable outputs are rebuilt on next use
+    mutable bool m_stakeable_outputs_dirty GUARDED_BY(cs_wallet){true};
+
     /** Number of pre-generated keys/scripts by each spkm (part of the look-ahead process, used to detect payments) */
     int64_t m_keypool_size{DEFAULT_KEYPOOL_SIZE};
 
@@ -1045,9 +1068,6 @@ public:
     /* Is staking closing */
     bool IsStakeClosing();
 
-    /* Staking thread group */
-    std::unique_ptr<std::vector<std::thread>> threadStakeMinerGroup;
-
     //! Whether the (external) signer performs R-value signature grinding
     bool CanGrindR() const;
 };